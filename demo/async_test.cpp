@@ -0,0 +1,62 @@
+// Test group with the async cases (illustrative purposes)
+#include "tested_async.h"
+#include <unistd.h>
+
+#if defined(TESTED_EPOLL_SUPPORTED)
+
+// The pipe lives until the case is complete, callbacks capture the pointer to it
+struct Pipe
+{
+   int Fds[2];
+
+   int Read() const { return Fds[0]; }
+   int Write() const { return Fds[1]; }
+
+   void Open() { tested::FailIf(pipe(Fds) != 0, "Failed to create pipe"); }
+   void Close()
+   {
+      close(Fds[0]);
+      close(Fds[1]);
+   }
+};
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   const tested::Completion done = runtime->StartAsyncCase("PipeEcho", 1000);
+
+   static Pipe echo;
+   echo.Open();
+
+   tested::EventLoop& loop = tested::EventLoop::Instance();
+   loop.Watch(echo.Read(), EPOLLIN, [done](unsigned events)
+   {
+      char text[8] = {};
+      const ssize_t size = read(echo.Read(), text, sizeof(text));
+      echo.Close();
+      tested::Is((events & EPOLLIN) != 0, "Pipe is readable");
+      tested::Eq(size, 4, "Whole message is received");
+      done.Pass();
+   });
+   loop.After(50, [] { tested::Eq(write(echo.Write(), "ping", 4), 4, "Message is sent"); });
+}
+
+#endif
+
+// Both cases wait 200 ms at the same time, the timers go by tested::Clock, so with nothing
+// else to wait for the group takes no real time
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   const tested::Completion done = runtime->StartAsyncCase("SlowReplyA", 1000);
+   tested::EventLoop::Instance().After(200, [done] { done.Pass(); });
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   const tested::Completion done = runtime->StartAsyncCase("SlowReplyB", 1000);
+   tested::EventLoop::Instance().After(200, [done] { done.Pass(); });
+}
+
+void LinkAsyncTests()
+{
+   static tested::Group<CASE_COUNTER> x("async", __FILE__);
+}
@@ -0,0 +1,149 @@
+// Benchmarks for some std containers (illustrative purposes)
+#include "tested_bench.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("push_back");
+
+   tested::bench::Run(runtime, [](tested::bench::State& state)
+   {
+      std::vector<int> vec;
+      for (auto _: state)
+      {
+         vec.push_back(1);
+         tested::bench::DoNotOptimize(vec.data());
+      }
+   });
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("sort1k");
+
+   tested::bench::Run(runtime, [](tested::bench::State& state)
+   {
+      std::vector<int> vec(1000);
+      for (auto _: state)
+      {
+         state.PauseTiming();
+         for (size_t i = 0; i < vec.size(); ++i)
+            vec[i] = static_cast<int>((i * 7919) % 1000);
+         state.ResumeTiming();
+
+         std::sort(vec.begin(), vec.end());
+      }
+      state.SetCounter("items", static_cast<double>(vec.size()));
+   });
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("sort_sweep");
+
+   using namespace tested::bench;
+   const SweepResult sweep = Sweep(runtime, Range::Geometric(8, 1 << 20), [](State& state)
+   {
+      std::vector<int> vec(static_cast<size_t>(state.Arg()));
+      for (auto _: state)
+      {
+         state.PauseTiming();
+         for (size_t i = 0; i < vec.size(); ++i)
+            vec[i] = static_cast<int>((i * 2654435761u) % vec.size());
+         state.ResumeTiming();
+
+         std::sort(vec.begin(), vec.end());
+      }
+   });
+
+   ExpectComplexity(sweep, Complexity_ONLogN);
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("mutex_scaling");
+
+   std::mutex mutex;
+   long long shared = 0;
+   tested::bench::Scaling(runtime, tested::bench::ThreadOptions::PowersOfTwo(4),
+      [&](tested::bench::ThreadState& state)
+   {
+      while (state.KeepRunning())
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         ++shared;
+      }
+   });
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("vector_latency");
+
+   // The vector reallocates sometimes, which is visible in the tail
+   std::vector<int> vec;
+   tested::bench::LatencyOptions options;
+   options.RatePerSec = 100000;
+   options.DurationMs = 200;
+   tested::bench::Latency(runtime, options, [&] { vec.push_back(1); });
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("lower_bound_cache");
+
+   std::vector<int> table(1 << 20);
+   for (size_t i = 0; i < table.size(); ++i)
+      table[i] = static_cast<int>(i * 2);
+
+   tested::bench::Options options;
+   options.CacheMode = tested::bench::CacheMode_Both;
+   options.Evict = tested::bench::Evict_Flush;
+
+   int key = 0;
+   tested::bench::Run(runtime, [&](tested::bench::State& state)
+   {
+      state.SetWorkingSet(table.data(), table.size() * sizeof(int));
+      for (auto _: state)
+      {
+         key = (key + 7919) % (1 << 21);
+         tested::bench::DoNotOptimize(std::lower_bound(table.begin(), table.end(), key));
+      }
+   }, options);
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("sort_is_fast_enough");
+
+   std::vector<int> vec(4096);
+   for (size_t i = 0; i < vec.size(); ++i)
+      vec[i] = static_cast<int>((i * 2654435761u) % 10007);
+
+   auto copyOnly = [&]
+   {
+      std::vector<int> copy(vec.rbegin(), vec.rend());
+      tested::bench::DoNotOptimize(copy.data());
+   };
+   auto sortCopy = [&]
+   {
+      std::vector<int> copy(vec.rbegin(), vec.rend());
+      std::sort(copy.begin(), copy.end());
+      tested::bench::DoNotOptimize(copy.data());
+   };
+
+   // The limits are a few times over the measured 50-150x of the copy, which is built with the
+   // same flags, so they hold in unoptimized builds too but catch a sort which got much slower
+   static tested::bench::Timing s_copy;
+   tested::bench::Time(copyOnly, tested::bench::TimingOptions(), s_copy);
+   tested::bench::ExpectPercentileUnder(sortCopy, 0.9, 500 * s_copy.Median());
+   tested::bench::ExpectRelative(sortCopy, copyOnly, 400);
+}
+
+void LinkBenchTests()
+{
+   static tested::Group<CASE_COUNTER> x("bench.std", __FILE__);
+}
@@ -0,0 +1,117 @@
+// Test group with the checks over generated inputs (illustrative purposes)
+#include "tested.h"
+#include "tested_check.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+typedef std::vector<int> Numbers;
+
+static long long SumScalar(const Numbers& numbers)
+{
+   long long sum = 0;
+   for (int value : numbers)
+      sum += value;
+   return sum;
+}
+
+static long long SumUnrolled(const Numbers& numbers)
+{
+   long long partial[4] = {};
+   size_t i = 0;
+   for (; i + 4 <= numbers.size(); i += 4)
+   {
+      partial[0] += numbers[i];
+      partial[1] += numbers[i + 1];
+      partial[2] += numbers[i + 2];
+      partial[3] += numbers[i + 3];
+   }
+   for (; i < numbers.size(); ++i)
+      partial[0] += numbers[i];
+   return partial[0] + partial[1] + partial[2] + partial[3];
+}
+
+static long long SumSplit(const Numbers& numbers)
+{
+   const size_t half = numbers.size() / 2;
+   long long low = 0;
+   long long high = 0;
+   for (size_t i = 0; i < half; ++i)
+      low += numbers[i];
+   for (size_t i = half; i < numbers.size(); ++i)
+      high += numbers[i];
+   return low + high;
+}
+
+static Numbers RandomNumbers(tested::check::Rng& rng, size_t)
+{
+   Numbers numbers(static_cast<size_t>(rng.Below(100)));
+   for (int& value : numbers)
+      value = static_cast<int>(rng.Range(-1000000, 1000000));
+   return numbers;
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("SumDifferential");
+
+   static const tested::check::Implementation<Numbers, long long> implementations[] =
+   {
+      { "scalar", SumScalar },
+      { "unrolled", SumUnrolled },
+      { "split", SumSplit },
+   };
+   tested::check::Differential(implementations, RandomNumbers);
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("SortProperties");
+
+   tested::check::Property(tested::check::Arbitrary<Numbers>(), [](const Numbers& numbers)
+   {
+      Numbers sorted(numbers);
+      std::sort(sorted.begin(), sorted.end());
+      tested::Is(std::is_sorted(sorted.begin(), sorted.end()), "Sorted in ascending order");
+      tested::Eq(SumScalar(sorted), SumScalar(numbers), "Sorting keeps the elements");
+   });
+}
+
+// Maximum with the bug: it starts from zero, so it is wrong when all the numbers are negative
+static int MaxFromZero(const Numbers& numbers)
+{
+   int result = 0;
+   for (int value : numbers)
+      result = (std::max)(result, value);
+   return result;
+}
+
+// The property does not hold, the case expects the failure and shows the counterexample which
+// is shrunk from the generated input
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("MaxCounterexample");
+
+   try
+   {
+      tested::check::Property(tested::check::Arbitrary<Numbers>(), [](const Numbers& numbers)
+      {
+         return numbers.empty() ||
+            MaxFromZero(numbers) == *std::max_element(numbers.begin(), numbers.end());
+      });
+   }
+   catch (const tested::CaseFailed& failed)
+   {
+      printf("%s\n", failed.Message.CData());
+      tested::Is(strstr(failed.Message.CData(), "counterexample: [-1]\n") != nullptr,
+         "Counterexample is minimal");
+      return;
+   }
+   tested::Fail("Bug is not found");
+}
+
+void LinkCheckTests()
+{
+   static tested::Group<CASE_COUNTER> x("check", __FILE__);
+}
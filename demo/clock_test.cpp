@@ -0,0 +1,70 @@
+// Test group with the code which waits for the timeouts (illustrative purposes)
+#include "tested_async.h"
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+
+// The code under test is built against tested::Clock instead of std::chrono::steady_clock
+typedef tested::Clock DemoClock;
+
+// Polls the flag with the growing pause until the timeout
+static bool WaitForFlag(const std::atomic<bool>& flag, std::chrono::milliseconds timeout)
+{
+   const DemoClock::time_point deadline = DemoClock::now() + timeout;
+   std::chrono::milliseconds pause(1);
+   while (!flag.load())
+   {
+      if (DemoClock::now() >= deadline)
+         return false;
+      DemoClock::SleepFor(pause);
+      pause = (std::min)(pause * 2, std::chrono::milliseconds(500));
+   }
+   return true;
+}
+
+// Ten seconds of the timeout pass at once
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("TimeoutExpires");
+
+   const std::chrono::steady_clock::time_point realStart = std::chrono::steady_clock::now();
+   const DemoClock::time_point start = DemoClock::now();
+   std::atomic<bool> flag(false);
+   tested::Not(WaitForFlag(flag, std::chrono::seconds(10)), "Nobody sets the flag");
+
+   tested::Is(DemoClock::now() - start >= std::chrono::seconds(10), "Timeout has passed");
+   if (tested::Clock::IsVirtual())
+      tested::Is(std::chrono::steady_clock::now() - realStart < std::chrono::seconds(1),
+         "Timeout is not waited for real");
+}
+
+// The helper thread is the participant, so the clock does not jump past it while it works
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("HelperSetsFlag");
+
+   const DemoClock::time_point start = DemoClock::now();
+   std::atomic<bool> flag(false);
+   std::thread helper([&flag](tested::Clock::Participant)
+   {
+      DemoClock::SleepFor(std::chrono::seconds(2));
+      flag = true;
+   }, tested::Clock::Participant());
+   const bool isSet = WaitForFlag(flag, std::chrono::seconds(5));
+   helper.join();
+
+   tested::Is(isSet, "Flag is set before the timeout");
+   tested::Is(DemoClock::now() - start >= std::chrono::seconds(2), "Helper has slept");
+}
+
+// The real sleep is reported, the runner includes tested_sleep_meter.h
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("RealSleep");
+   usleep(20000);
+}
+
+void LinkClockTests()
+{
+   static tested::Group<CASE_COUNTER> x("clock", __FILE__);
+}
@@ -0,0 +1,67 @@
+// Test group with the coroutine cases (illustrative purposes), it is empty without C++20
+#include "tested_coro.h"
+#include <unistd.h>
+
+#if defined(TESTED_CORO_SUPPORTED)
+
+#if defined(TESTED_EPOLL_SUPPORTED)
+
+// The pipe is a local of the task, it is closed also when the case times out
+struct CoroPipe
+{
+   int Fds[2];
+
+   CoroPipe() { tested::FailIf(pipe(Fds) != 0, "Failed to create pipe"); }
+   ~CoroPipe()
+   {
+      close(Fds[0]);
+      close(Fds[1]);
+   }
+};
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   tested::StartTask(runtime, "PipeEcho", 1000, []() -> tested::Task
+   {
+      CoroPipe echo;
+      co_await tested::Sleep(50);
+      tested::Eq(write(echo.Fds[1], "ping", 4), 4, "Message is sent");
+
+      const unsigned events = co_await tested::Readable(echo.Fds[0]);
+      char text[8] = {};
+      tested::Is((events & EPOLLIN) != 0, "Pipe is readable");
+      tested::Eq(read(echo.Fds[0], text, sizeof(text)), 4, "Whole message is received");
+   });
+}
+
+#endif
+
+tested::Task Countdown(int from, int stepMs)
+{
+   for (int i = from; i > 0; --i)
+      co_await tested::Sleep(stepMs);
+}
+
+// The nested tasks of both cases wait at the same time on the virtual clock
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   tested::StartTask(runtime, "CountdownA", 1000, [](int steps) -> tested::Task
+   {
+      co_await Countdown(steps, 20);
+   }, 10);
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   tested::StartTask(runtime, "CountdownB", 1000, [](int steps) -> tested::Task
+   {
+      co_await Countdown(steps, 40);
+   }, 5);
+}
+
+#endif
+
+void LinkCoroTests()
+{
+   static tested::Group<CASE_COUNTER> x("coro", __FILE__);
+}
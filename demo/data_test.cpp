@@ -0,0 +1,88 @@
+// Test group for the memory mapped test data (illustrative purposes)
+#include "tested.h"
+#include "tested_data.h"
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("WordCount");
+
+   const tested::data::Bytes words = tested::data::Map(DEMO_DATA_DIR "/words.txt");
+   tested::Eq(std::count(words.begin(), words.end(), '\n'), 10, "There are 10 words");
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("MappedOnce");
+
+   // The second request returns the same pages, the file is not read again
+   const tested::data::Bytes first = tested::data::Map(DEMO_DATA_DIR "/words.txt");
+   const tested::data::Bytes second = tested::data::Map(DEMO_DATA_DIR "/words.txt",
+      tested::data::Prefetch_WillNeed);
+   tested::Is(first.Data == second.Data, "File is mapped once per process");
+   tested::Is(second.Sub(0, 5).View() == "alpha");
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("ScratchFile");
+
+   // The directory is removed after the case, the file left there would be reported, so the
+   // case cleans up after itself
+   char path[512];
+   snprintf(path, sizeof(path), "%s/words.txt", runtime->ScratchDir());
+   FILE* file = fopen(path, "w");
+   tested::Is(file != nullptr, "Scratch directory is writable");
+   fputs("alpha\n", file);
+   fclose(file);
+   tested::Is(remove(path) == 0, "File is removed");
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("SquaresSnapshot");
+
+   // Output is compared line by line as it is produced, TESTED_UPDATE_GOLDEN=1 rewrites it
+   tested::data::Snapshot snapshot(DEMO_DATA_DIR "/golden/squares.txt");
+   for (int i = 0; i < 1000; ++i)
+   {
+      char line[64];
+      const int length = snprintf(line, sizeof(line), "%d %d\n", i, i * i);
+      snapshot.Write(line, length);
+   }
+   snapshot.Finish();
+}
+
+// Generated case for each 'name.in' file, the output is compared with 'name.out'
+static void UpperCasePair(tested::IRuntime* runtime)
+{
+   const tested::GeneratedCase& pair = runtime->Generated();
+   runtime->StartCase(pair.Name);
+   tested::Is(pair.Data[0] != 0, "Directory with input files is missing");
+
+   char expectedPath[tested::data::kMaxPath];
+   snprintf(expectedPath, sizeof(expectedPath), "%.*s.out", 
+      static_cast<int>(strlen(pair.Data) - 3), pair.Data);
+
+   const tested::data::Bytes input = tested::data::Map(pair.Data, tested::data::Prefetch_Sequential);
+   tested::data::Snapshot snapshot(expectedPath);
+   for (size_t offset = 0; offset < input.size(); offset += 4096)
+   {
+      char chunk[4096];
+      const tested::data::Bytes part = input.Sub(offset, sizeof(chunk));
+      std::transform(part.begin(), part.end(), chunk, [](unsigned char c) { return toupper(c); });
+      snapshot.Write(chunk, part.size());
+   }
+   snapshot.Finish();
+}
+
+void LinkDataTests()
+{
+   static tested::Group<CASE_COUNTER> x("data", __FILE__);
+   static tested::GeneratedGroup<64, 4096> pairs("data.upper", __FILE__, 
+      [](tested::CaseSink& sink) { tested::data::AddFiles(sink, DEMO_DATA_DIR "/upper", ".in"); },
+      UpperCasePair);
+}
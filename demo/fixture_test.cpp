@@ -0,0 +1,59 @@
+// Test group with the group fixture (illustrative purposes)
+#include "tested.h"
+#include "lookup_table.h"
+#include <algorithm>
+#include <vector>
+
+// The state which is expensive to create: it is made once for all cases of the group
+struct PrimesFixture
+{
+   std::vector<int> Primes;
+
+   PrimesFixture()
+   {
+      std::vector<bool> composite(100000);
+      for (int i = 2; i < static_cast<int>(composite.size()); ++i)
+      {
+         if (composite[i])
+            continue;
+         Primes.push_back(i);
+         for (int k = 2 * i; k < static_cast<int>(composite.size()); k += i)
+            composite[k] = true;
+      }
+   }
+};
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("Count");
+
+   const PrimesFixture& fixture = runtime->Fixture<PrimesFixture>();
+   tested::Eq(fixture.Primes.size(), 9592u, "There are 9592 primes below 100000");
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("AllOdd");
+
+   const PrimesFixture& fixture = runtime->Fixture<PrimesFixture>();
+   for (size_t i = 1; i < fixture.Primes.size(); ++i)
+      tested::Is(fixture.Primes[i] % 2 == 1, "Primes above 2 are odd");
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->UseResource<SquaresTable>("squares");
+   runtime->StartCase("SquaresNotPrime");
+
+   // The table is shared with "math" group and built only once per run
+   const PrimesFixture& fixture = runtime->Fixture<PrimesFixture>();
+   const SquaresTable& table = runtime->Resource<SquaresTable>();
+   for (size_t i = 2; i < 300; ++i)
+      tested::Not(std::binary_search(fixture.Primes.begin(), fixture.Primes.end(), table.Squares[i]),
+         "Square is not a prime");
+}
+
+void LinkFixtureTests()
+{
+   static tested::Group<CASE_COUNTER, PrimesFixture> x("primes", __FILE__);
+}
@@ -0,0 +1,62 @@
+// Test group with the fuzz target (illustrative purposes)
+#include "tested.h"
+#include "tested_fuzz.h"
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+typedef std::vector<std::pair<std::string, std::string>> Records;
+
+// Parses "key=value;" records, false if the text is not the list of records
+static bool ParseRecords(std::string_view text, Records& records)
+{
+   records.clear();
+   size_t position = 0;
+   while (position < text.size())
+   {
+      const size_t equals = text.find('=', position);
+      const size_t end = text.find(';', position);
+      if (equals == std::string_view::npos || end == std::string_view::npos || equals > end ||
+         equals == position)
+         return false;
+
+      const std::string_view value = text.substr(equals + 1, end - equals - 1);
+      if (value.find('=') != std::string_view::npos)
+         return false;
+
+      records.emplace_back(std::string(text.substr(position, equals - position)), std::string(value));
+      position = end + 1;
+   }
+   return true;
+}
+
+static std::string PrintRecords(const Records& records)
+{
+   std::string text;
+   for (const auto& record : records)
+      text += record.first + "=" + record.second + ";";
+   return text;
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+{
+   runtime->StartCase("RecordsRoundTrip");
+
+   // "test_runner --fuzz fuzz:RecordsRoundTrip" grows the corpus, the regular run replays it
+   tested::fuzz::Target(DEMO_DATA_DIR "/fuzz/records", [](tested::data::Bytes input)
+   {
+      Records records;
+      if (!ParseRecords(input.View(), records))
+         return;
+
+      Records parsed;
+      tested::Is(ParseRecords(PrintRecords(records), parsed), "Printed records are valid");
+      tested::Is(parsed == records, "Printed records are parsed back");
+   });
+}
+
+void LinkFuzzTests()
+{
+   static tested::Group<CASE_COUNTER> x("fuzz", __FILE__);
+}
@@ -0,0 +1,15 @@
+// Shared resource used by the cases of several demo groups (illustrative purposes)
+#pragma once
+#include <vector>
+
+// The table which is too expensive to build for every case or group
+struct SquaresTable
+{
+   std::vector<long long> Squares;
+
+   SquaresTable(): Squares(1000000)
+   {
+      for (size_t i = 0; i < Squares.size(); ++i)
+         Squares[i] = static_cast<long long>(i) * static_cast<long long>(i);
+   }
+};
@@ -1,5 +1,6 @@
 // Test group for some basic math operations
 #include "tested.h"
+#include "lookup_table.h"
 
 template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runner)
 {
@@ -13,6 +14,51 @@ template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runner)
    tested::FailIf(2 * 2 != 4, "Multiplication does not work");
 }
 
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runner)
+{
+   runner->UseResource<SquaresTable>("squares");
+   runner->StartCase("SquareLookup");
+
+   const SquaresTable& table = runner->Resource<SquaresTable>();
+   tested::Eq(table.Squares[12], 144, "Square of 12 is 144");
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runner)
+{
+   struct Row { int Dividend; int Divisor; int Quotient; int Remainder; };
+   static const Row rows[] = 
+   {
+      {  7,  2,  3,  1 },
+      { -7,  2, -3, -1 },
+      {  7, -2, -3,  1 },
+      {  0,  5,  0,  0 },
+   };
+
+   // Each row is the sub-case 'math:Division[row]'
+   const Row& row = runner->StartTable("Division", rows);
+   tested::Eq(row.Dividend / row.Divisor, row.Quotient, "Quotient is truncated toward zero");
+   tested::Eq(row.Dividend % row.Divisor, row.Remainder, "Remainder has sign of dividend");
+}
+
+constexpr int Gcd(int a, int b)
+{
+   return b == 0 ? a : Gcd(b, a % b);
+}
+
+// Evaluated by the compiler, a failed check breaks the build
+constexpr bool GcdChecks()
+{
+   tested::Eq(Gcd(12, 18), 6, "Gcd of 12 and 18 is 6");
+   tested::Eq(Gcd(17, 5), 1, "Gcd of coprime numbers is 1");
+   tested::Eq(Gcd(0, 9), 9, "Gcd with zero is the other number");
+   return true;
+}
+
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runner)
+{
+   runner->StartCompileTimeCase<GcdChecks>("Gcd");
+}
+
 // Linker is not going to include this file unless we reference any symbol from it
 void LinkMathTests()
 {
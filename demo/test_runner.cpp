@@ -1,21 +1,49 @@
 //  (c) 2018 Vladimir Zvezda
 //
 //  An example of the console app that can run the tests registered in test libraries.
+
 #include "tested.h"
+#include "tested_async.h"
+#include "tested_bench.h"
+#include "tested_forked.h"
+#include "tested_fuzz.h"
+#include "tested_sleep_meter.h" // the real sleeps of the cases are reported
+#include <optional>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 //-------------------------------------------------------------------------------------------------
 // We need to reference a symbol from test libraries or linker strip test cases from executable
 //-------------------------------------------------------------------------------------------------
 extern void LinkMathTests();
 extern void LinkVectorTests();
+extern void LinkBenchTests();
+extern void LinkFixtureTests();
+extern void LinkDataTests();
+extern void LinkCheckTests();
+extern void LinkFuzzTests();
+extern void LinkAsyncTests();
+extern void LinkCoroTests();
+extern void LinkClockTests();
 
 static void RegisterTests()
 {
    LinkMathTests();
    LinkVectorTests();
+   LinkBenchTests();
+   LinkFixtureTests();
+   LinkDataTests();
+   LinkCheckTests();
+   LinkFuzzTests();
+   LinkAsyncTests();
+   LinkCoroTests();
+   LinkClockTests();
 }
 
+// Slots of the async cases in flight and the tables of their event loop
+static tested::AsyncRunner<256> s_asyncRunner;
+
 class ExporterImpl final: public tested::Subset::ICaseExporter
 {
 public:
@@ -26,7 +54,17 @@ public:
 
    virtual void OnCase(const ExportedCase& testCase)
    {
-      printf("Test: %s %d %p\n", testCase.CaseName, testCase.CaseNumber, testCase.CaseProc);
+      if (testCase.RowName != nullptr)
+         printf("Test: %s<%s> %d %p\n", testCase.CaseName, testCase.RowName, testCase.CaseNumber,
+            testCase.CaseProc);
+      else if (testCase.Row >= 0)
+         printf("Test: %s[%d] %d %p\n", testCase.CaseName, testCase.Row, testCase.CaseNumber,
+            testCase.CaseProc);
+      else if (testCase.CompileTime)
+         printf("Test: %s %d %p (compile time)\n", testCase.CaseName, testCase.CaseNumber,
+            testCase.CaseProc);
+      else
+         printf("Test: %s %d %p\n", testCase.CaseName, testCase.CaseNumber, testCase.CaseProc);
    }
 
    virtual void OnDone() 
@@ -50,6 +88,80 @@ int main(int argc, const char* argv[])
       MainCode_FailedToParse,
    };
 
+   // The protocol of interleaved A/B benchmarking, this binary can be either side
+   int workerCode = 0;
+   if (tested::bench::AbWorker::Handle(argc, argv, workerCode))
+      return workerCode;
+
+   // Compare benchmarks of two builds: --ab <binaryA> <binaryB>
+   if (argc == 4 && strcmp(argv[1], "--ab") == 0)
+   {
+      tested::bench::AbDriver driver(argv[2], argv[3]);
+      const int slower = driver.Run();
+      return slower < 0 ? MainCode_FailedToStart : (slower > 0 ? MainCode_TestsFailed : MainCode_Ok);
+   }
+
+   // Benchmark options:
+   //    --save-baseline <file>   save benchmark results as a baseline
+   //    --baseline <file>        compare benchmark results with baseline, regression fails a case
+   //    --threshold <percent>    slowdown of median counted as regression (default 5)
+   //    --pin-cpu <cpu>          pin benchmarks to the cpu
+   //    --json <file>            write benchmark results in Google Benchmark JSON format
+   //    --ab <binaryA> <binaryB> interleaved comparison of benchmarks in two builds
+   // Isolation options:
+   //    --workers <n>            run the groups in n forked workers
+   // Async options:
+   //    --async-limit <n>        at most n async cases in flight at once
+   //    --real-time 1            tested::Clock does not skip the waits
+   // Fuzzing options:
+   //    --fuzz <address>         fuzz the case in the workers (one per cpu by default)
+   //    --fuzz-seconds <n>       time limit of fuzzing (default 60)
+   tested::bench::Settings benchSettings;
+   const char* jsonPath = nullptr;
+   int workers = 0;
+   const char* fuzzAddress = nullptr;
+   int fuzzSeconds = 60;
+   int asyncLimit = 0;
+   for (int i = 1; i + 1 < argc; i += 2)
+   {
+      if (strcmp(argv[i], "--save-baseline") == 0)
+         benchSettings.BaselineOut = argv[i + 1];
+      else if (strcmp(argv[i], "--baseline") == 0)
+         benchSettings.BaselineIn = argv[i + 1];
+      else if (strcmp(argv[i], "--threshold") == 0)
+         benchSettings.RegressionThreshold = atof(argv[i + 1]) / 100;
+      else if (strcmp(argv[i], "--pin-cpu") == 0)
+         benchSettings.PinCpu = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "--json") == 0)
+         jsonPath = argv[i + 1];
+      else if (strcmp(argv[i], "--workers") == 0)
+         workers = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "--async-limit") == 0)
+         asyncLimit = atoi(argv[i + 1]);
+      else if (strcmp(argv[i], "--real-time") == 0)
+         tested::Clock::SetVirtual(atoi(argv[i + 1]) == 0);
+      else if (strcmp(argv[i], "--fuzz") == 0)
+         fuzzAddress = argv[i + 1];
+      else if (strcmp(argv[i], "--fuzz-seconds") == 0)
+         fuzzSeconds = atoi(argv[i + 1]);
+      else
+      {
+         printf("test_runner: unknown option '%s'\n", argv[i]);
+         return MainCode_FailedToParse;
+      }
+   }
+
+   if (fuzzAddress != nullptr)
+   {
+      tested::fuzz::Options fuzzOptions;
+      fuzzOptions.Workers = workers;
+      fuzzOptions.Seconds = fuzzSeconds;
+      tested::fuzz::Runner runner(fuzzOptions);
+      tested::Subset target = tested::Storage::Instance().ByAddress(fuzzAddress);
+      const tested::Subset::Stats fuzzInfo = runner.Run(target);
+      return (fuzzInfo.Failed != 0) ? MainCode_TestsFailed : MainCode_Ok;
+   }
+
    printf("test_runner: running all registered tests\n\n"); 
 
 
@@ -70,24 +182,44 @@ int main(int argc, const char* argv[])
    //tested::Subset myGroup = allTests.ByGroupAndCaseNumber("std.vector", 1);
    //tested::Subset myGroup = allTests.ByAddress("std.vector:*");
 
+   if (asyncLimit > 0)
+      tests = tests.LimitAsync(asyncLimit);
+
    try
    {
-      //const tested::Subset::Stats runInfo = tests.Run();
-
       ExporterImpl exporter;
       tests.Export(&exporter);
 
+      // Shared resources are built here once and workers share them copy-on-write
+      if (workers > 0)
+      {
+         tested::forked::Runner runner((tested::forked::Options(workers)));
+         const tested::Subset::Stats runInfo = runner.Run(tests);
+
+         printf("\n=======================================================================\n");
+         printf("Test run completed in %d workers:\n", workers);
+         printf("   Passed : %d\n", runInfo.Passed);
+         printf("   Skipped: %d\n", runInfo.Skipped);
+         printf("   Failed : %d\n", runInfo.Failed);
+         return (runInfo.Failed != 0) ? MainCode_TestsFailed : MainCode_Ok;
+      }
+
+      // The json file is only created with --json
+      std::optional<tested::bench::JsonObserver> json;
+      if (jsonPath != nullptr)
+         json.emplace(jsonPath, argv[0]);
+      tested::bench::Session benchSession(benchSettings, nullptr, json ? &*json : nullptr);
+      const tested::Subset::Stats runInfo = tests.Run(&benchSession);
+      benchSession.Finish();
+
       printf("\n=======================================================================\n");
 
-      /*
       printf("Test run completed:\n");
       printf("   Passed : %d\n", runInfo.Passed);
       printf("   Skipped: %d\n", runInfo.Skipped);
       printf("   Failed : %d\n", runInfo.Failed);
 
       return (runInfo.Failed != 0) ? MainCode_TestsFailed : MainCode_Ok;
-      */
-      return 0;
    }
    catch (const tested::ProcessCorruptedException& processCorrupted)
    {
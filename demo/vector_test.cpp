@@ -25,6 +25,20 @@ template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runner)
    tested::FailIf(vec.empty());
 }
 
+template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runner)
+{
+   // Each type is the sub-case, e.g. 'std.vector:Resize<double>'
+   runner->StartTyped("Resize", tested::Types<char, int, double>(), [](auto type)
+   {
+      typedef typename decltype(type)::type T;
+
+      std::vector<T> vec;
+      vec.resize(3);
+      tested::Eq(vec.size(), 3u);
+      tested::Is(vec[2] == T(), "New elements are value-initialized");
+   });
+}
+
 void LinkVectorTests()
 {
    static tested::Group<CASE_COUNTER> x("std.vector",  __FILE__);
@@ -29,17 +29,31 @@
 //  TODO:
 //     * runtime customization 
 //     * tags
-//     * Async tests
 //     * to c++03
 //     * Emscripten demo
 //
 #pragma once
 
 #include <string_view>
+#include <string>
 #include <algorithm>
 #include <stdio.h>
+#include <string.h>
 #include <exception>
+#include <stdint.h>
+#include <limits.h>
 #include <cstddef>
+#include <new>
+#include <mutex>
+#include <chrono>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TESTED_SCRATCH_SUPPORTED 1
+#endif
 
 // First, there are some hooks to customize the tested.h for your project needs which you can do
 // without the modification of tested.h itself. 
@@ -65,10 +79,10 @@ namespace tested
 // With C++17 it is possible to make some project specific configuration
 #ifdef __has_include
 #if __has_include("tested_customize.h")
-#include "tested_customize.h""
+#include "tested_customize.h"
 #endif
 #elif defined(TESTED_CUSTOMIZE)
-#include "tested_customize.h""
+#include "tested_customize.h"
 #endif
 
 #if __cplusplus <= 199711L
@@ -129,7 +143,7 @@ struct StringStorage
 
    void Assign(std::string_view msg)
    {
-      const size_t maxSize = (std::min<size_t>)(SizeP, msg.length());
+      const size_t maxSize = (std::min<size_t>)(SizeP - 1, msg.length());
       std::copy_n(msg.cbegin(), maxSize, StorageBuf);
       StorageBuf[maxSize] = 0;
    }
@@ -140,6 +154,153 @@ struct StringStorage
    char* Data() { return StorageBuf; }
 };
 
+// Shared resource is the expensive state (e.g. in-process database or lookup table) used by cases 
+// of many groups. It is built on the first request, shared across groups and threads, and destroyed 
+// when the last case that declared it finishes. All the resources are linked in the global list.
+struct ResourceEntry
+{
+   ResourceEntry* Next;
+   const char*    Name;
+   void*          Storage;
+   void*        (*Create)(void* storage);
+   void         (*Destroy)(void* instance);
+   void*          Instance; // built instance or nullptr
+   int            Users;    // cases selected to run which declared it and not yet finished
+   bool           Pinned;   // built in advance by Subset::BuildResources(), kept over the runs
+
+   static ResourceEntry*& ListHead() { static ResourceEntry* head = nullptr; return head; }
+   static std::mutex& Lock() { static std::mutex lock; return lock; }
+
+   // Tears down the instance, e.g. when last user is done or test run is over
+   void Release()
+   {
+      if (Instance == nullptr || Pinned)
+         return;
+      void* instance = Instance;
+      Instance = nullptr;
+      Destroy(instance);
+   }
+};
+
+// Static storage for the resource of type T, the entry is registered on first use
+template <typename T>
+struct SharedResource
+{
+   static ResourceEntry& Entry(const char* name)
+   {
+      alignas(T) static unsigned char storage[sizeof(T)];
+      static ResourceEntry entry = { nullptr, nullptr, storage, Create, Destroy, nullptr, 0, false };
+      static const bool registered = Register(entry);
+      (void)registered;
+
+      if (entry.Name == nullptr && name != nullptr)
+         entry.Name = name;
+      return entry;
+   }
+
+private:
+   static void* Create(void* storage) { return new (storage) T(); }
+   static void Destroy(void* instance) { static_cast<T*>(instance)->~T(); }
+
+   static bool Register(ResourceEntry& entry)
+   {
+      std::lock_guard<std::mutex> lock(ResourceEntry::Lock());
+      entry.Next = ResourceEntry::ListHead();
+      ResourceEntry::ListHead() = &entry;
+      return true;
+   }
+};
+
+// The case made at runtime by the generator of GeneratedGroup, e.g. for each file in directory.
+// The strings are kept in the bounded arena of the group.
+struct GeneratedCase
+{
+   const char* Name;
+   const char* Data;
+};
+
+// Type list of the typed case, see IRuntime::StartTyped()
+template <typename... T> struct Types {};
+
+// The tag passed to the body of typed case
+template <typename T> struct Type { typedef T type; };
+
+// The name of the type in 'group:case<T>' address. By default it is taken from the compiler 
+// signature of Get(), specialize it for the shorter names:
+//
+//    template <> struct tested::TypeName<std::string> { static const char* Get() { return "string"; } };
+//
+template <typename T>
+struct TypeName
+{
+   static const char* Get()
+   {
+      // The static is initialized once even when the cases of many threads ask for the name
+#if defined(_MSC_VER)
+      // "const char *__cdecl tested::TypeName<int>::Get(void)"
+      static const Buffer name = Parse(__FUNCSIG__, "TypeName<", '>');
+#else
+      // "static const char* tested::TypeName<T>::Get() [with T = int]" or "[T = int]"
+      static const Buffer name = Parse(__PRETTY_FUNCTION__, "T = ", ']');
+#endif
+      return name.Text;
+   }
+
+   struct Buffer
+   {
+      char Text[128];
+   };
+
+   // Copies the type name between the prefix and the last character of the signature
+   static Buffer Parse(const char* signature, const char* prefix, char last)
+   {
+      Buffer name = {};
+      const char* begin = strstr(signature, prefix) + strlen(prefix);
+      const char* end = strrchr(signature, last);
+      const size_t length = (std::min)(sizeof(name.Text) - 1, static_cast<size_t>(end - begin));
+      std::copy_n(begin, length, name.Text);
+      return name;
+   }
+};
+
+// Receives the results of async cases, implemented by the runtime which runs them. The owner 
+// identifies the async case, 0 is none.
+struct IAsyncOwners
+{
+   virtual void Complete(unsigned owner, CaseResult_t code, std::string_view message) = 0;
+   virtual bool IsDone(unsigned owner) const = 0;
+
+   // The callback of the case spent the time in real sleeps, see SleepMeter
+   virtual void AddSleep(unsigned owner, long long nanoseconds) {}
+};
+
+// Handle of the running async case, see IRuntime::StartAsyncCase(). It is small and copyable, 
+// so callbacks capture it by value. Only the first result counts, the handle of the complete 
+// case does nothing.
+class Completion
+{
+public:
+   Completion() : m_owners(nullptr), m_owner(0) {}
+   Completion(IAsyncOwners* owners, unsigned owner) : m_owners(owners), m_owner(owner) {}
+
+   void Pass() const { Complete(CaseResult_Passed, std::string_view()); }
+   void Fail(std::string_view message = "") const { Complete(CaseResult_Failed, message); }
+   void Skip(std::string_view message = "") const { Complete(CaseResult_Skipped, message); }
+
+   bool IsDone() const { return m_owners == nullptr || m_owners->IsDone(m_owner); }
+   unsigned Owner() const { return m_owner; }
+
+private:
+   void Complete(CaseResult_t code, std::string_view message) const
+   {
+      if (m_owners != nullptr)
+         m_owners->Complete(m_owner, code, message);
+   }
+
+   IAsyncOwners* m_owners;
+   unsigned      m_owner;
+};
+
 // This is the runtime API of 'tested' library avaiable to test case via parameter. There are two 
 // private implementation for this interface: one is to collect all test function and another is to 
 // actually run the tests.
@@ -149,9 +310,169 @@ struct IRuntime: RuntimeCustomization<Customized>
    // storage with static lifetime as test name and description because API does not make the 
    // copy of the data.
    virtual void StartCase(const char* caseName, const char* description = nullptr) = 0;
-   // TODO: virtual callback StartAsyncCase();
+
+   // Asynchronous case. The case returns before it is done and reports the result through the 
+   // completion handle from the callbacks of EventLoop, so many I/O bound cases are in flight on
+   // one thread. The loop comes with the backend (tested_async.h), without it the case fails. 
+   // It also fails if it is not complete in timeoutMs (0 is no timeout):
+   //
+   //    const tested::Completion done = runtime->StartAsyncCase("echo", 1000);
+   //    tested::EventLoop::Instance().Watch(fd, EPOLLIN, [done, fd](unsigned events)
+   //    {
+   //       tested::Is(events & EPOLLIN, "Echo is received");
+   //       ...
+   //       done.Pass();
+   //    });
+   //
+   // The watches and timers registered by the case and by its callbacks belong to the case: a
+   // failed assertion in them fails the case and they are dropped when the case is complete.
+   // Async cases of the group with a fixture are complete before the next group starts.
+   virtual Completion StartAsyncCase(const char* caseName, int timeoutMs = 5000,
+      const char* description = nullptr)
+   {
+      (void)timeoutMs;
+      StartCase(caseName, description);
+      return Completion();
+   }
+
+   // Table-driven case. Instead of StartCase() the case starts with the table of inputs, it is 
+   // invoked once for each row and each row is a separate sub-case 'group:case[row]' which can
+   // fail, be filtered or scheduled independently:
+   //
+   //    static const Row rows[] = { {"1", 1}, {"-1", -1}, {"0x10", 16} };
+   //    const Row& row = runtime->StartTable("parse", rows);
+   //    tested::Eq(Parse(row.Text), row.Expected);
+   //
+   // The table can be a C array or a container with size() and operator[], e.g. std::vector 
+   // filled at runtime. Rows do not consume the case ordinals.
+   template <typename RowT, size_t N>
+   const RowT& StartTable(const char* caseName, const RowT (&rows)[N])
+   {
+      return rows[StartRow(caseName, N)];
+   }
+
+   template <typename ContainerT>
+   const typename ContainerT::value_type& StartTable(const char* caseName, const ContainerT& rows)
+   {
+      return rows[StartRow(caseName, rows.size())];
+   }
+
+   // Typed case. The body is instantiated for each type of the list and each instantiation is 
+   // the sub-case 'group:case<T>', the type names are from TypeName<T>:
+   //
+   //    runtime->StartTyped("push_back", tested::Types<int, double>(), [](auto type)
+   //    {
+   //       typedef typename decltype(type)::type T;
+   //       std::vector<T> vec;
+   //       ...
+   //    });
+   //
+   // Only the body is the template, the registration and the reporting are shared code.
+   template <typename... T, typename BodyT>
+   void StartTyped(const char* caseName, Types<T...>, BodyT&& body)
+   {
+      static const char* const names[] = { TypeName<T>::Get()... };
+      typedef void (*Invoke_t)(BodyT&);
+      static const Invoke_t invokes[] = { &InvokeTyped<BodyT, T>... };
+      invokes[StartRow(caseName, sizeof...(T), names)](body);
+   }
+
+   // Starts the case with rowCount rows and returns the row to check in this invocation. The 
+   // rows can have names, e.g. the types of typed case.
+   virtual size_t StartRow(const char* caseName, size_t rowCount, 
+      const char* const* rowNames = nullptr, const char* description = nullptr)
+   {
+      (void)rowCount;
+      (void)rowNames;
+      StartCase(caseName, description);
+      return 0;
+   }
+
+   // Compile-time case. The checks are the constexpr function evaluated by the compiler, so the
+   // failed check breaks the build with the message of the check. The case is in the catalog
+   // and passes at runtime without running anything:
+   //
+   //    constexpr bool GcdChecks()
+   //    {
+   //       tested::Eq(Gcd(12, 18), 6, "Gcd of 12 and 18 is 6");
+   //       return true;
+   //    }
+   //    ...
+   //    runtime->StartCompileTimeCase<GcdChecks>("Gcd");
+   //
+   // The assertions (Is, Not, Eq, FailIf) are constexpr, in the constant evaluation the failed 
+   // one is reported as the call to non-constexpr Fail() with the message in its arguments.
+   template <bool (*ChecksP)()>
+   void StartCompileTimeCase(const char* caseName, const char* description = nullptr)
+   {
+      static_assert(ChecksP(), "Compile-time checks of the case returned false");
+      StartCompileTime(caseName, description);
+   }
+
+   // Starts the case which was checked by the compiler, reporters mark it
+   virtual void StartCompileTime(const char* caseName, const char* description = nullptr)
+   {
+      StartCase(caseName, description);
+   }
+
+   // The fixture of the case group, see Group<N, FixtureT>. It is constructed before the first 
+   // case of the group that is selected to run and destroyed after the last one.
+   template <typename FixtureT>
+   FixtureT& Fixture()
+   {
+      return *static_cast<FixtureT*>(GetGroupFixture(&TypeId<FixtureT>::Id));
+   }
+
+   // Unique address for the type without RTTI
+   template <typename T>
+   struct TypeId { static const char Id; };
+
+   // Declares that the case uses the shared resource T. It must be invoked before StartCase(), 
+   // so the run knows in advance how many selected cases need the resource:
+   //
+   //    runtime->UseResource<Database>("database");
+   //    runtime->StartCase("Lookup");
+   //    Database& db = runtime->Resource<Database>();
+   //
+   template <typename T>
+   void UseResource(const char* name)
+   {
+      DeclareResource(SharedResource<T>::Entry(name));
+   }
+
+   // Returns the declared shared resource, builds it if this is the first request
+   template <typename T>
+   T& Resource()
+   {
+      return *static_cast<T*>(AcquireResource(SharedResource<T>::Entry(nullptr)));
+   }
+
+   // The generated case which is invoked, see GeneratedGroup. The body of the generated case 
+   // starts with runtime->StartCase(runtime->Generated().Name).
+   const GeneratedCase& Generated() const;
+
+   // Empty directory private to the running case, on tmpfs (/dev/shm) when it is available. It 
+   // is created on the first request and removed recursively after the case, the files left
+   // there are reported. Request it from the case thread before passing the path to others.
+   const char* ScratchDir() { return GetScratchDir(); }
+
+protected:
+   template <typename BodyT, typename T>
+   static void InvokeTyped(BodyT& body) { body(Type<T>()); }
+
+   // Returns the group fixture if it has the given type, fails the case otherwise
+   virtual void* GetGroupFixture(const void* typeId);
+
+   virtual void DeclareResource(ResourceEntry&) {}
+   virtual void* AcquireResource(ResourceEntry& resource);
+   virtual const char* GetScratchDir();
+
+   // Set by the runtime before the generated case is invoked
+   const GeneratedCase* m_generatedCase = nullptr;
 };
 
+template <typename T> const char IRuntime::TypeId<T>::Id = 0;
+
 // Private exception classes
 struct CaseIsReal   {}; // thrown by StartCase() when Case<>() is specialized
 struct CaseIsStub   {}; // thrown by generic template of Case<>()
@@ -240,12 +561,13 @@ template <Ordinal_t N> static void Case(IRuntime*) { throw CaseIsStub(); };
 // Basic test flow control
 inline void Skip() { throw CaseSkipped(); }
 inline void Fail(std::string_view msg = "") {  throw CaseFailed(msg); }
-inline void FailIf(bool condition, std::string_view msg = "") { if (condition) Fail(msg); }
-inline void Is(bool condition, std::string_view msg = "")     { FailIf(!condition, msg); }
-inline void Not(bool condition, std::string_view msg = "")    { FailIf(condition, msg); }
+// The assertions are constexpr, so they also work in compile-time cases
+constexpr void FailIf(bool condition, std::string_view msg = "") { if (condition) Fail(msg); }
+constexpr void Is(bool condition, std::string_view msg = "")     { FailIf(!condition, msg); }
+constexpr void Not(bool condition, std::string_view msg = "")    { FailIf(condition, msg); }
 
 template <typename ActualT, typename ExpectedT>
-inline void Eq(const ActualT& actual, const ExpectedT& expected, std::string_view msg="")
+constexpr void Eq(const ActualT& actual, const ExpectedT& expected, std::string_view msg="")
 {
    // TODO: write actual and expected? It is difficult without dynamic memory
    // TODO: don't use reference for trivial types?
@@ -260,6 +582,132 @@ inline void ProcessCorrupted(std::string_view msg = std::string_view())
    throw ProcessCorruptedException(msg);
 }
 
+inline void* IRuntime::GetGroupFixture(const void*)
+{
+   Fail("Group fixture is only available to the running case");
+   return nullptr;
+}
+
+inline void* IRuntime::AcquireResource(ResourceEntry&)
+{
+   Fail("Shared resource is only available to the running case");
+   return nullptr;
+}
+
+inline const GeneratedCase& IRuntime::Generated() const
+{
+   if (m_generatedCase == nullptr)
+      Fail("The case is not generated");
+   return *m_generatedCase;
+}
+
+inline const char* IRuntime::GetScratchDir()
+{
+   Fail("Scratch directory is only available to the running case");
+   return nullptr;
+}
+
+// Per-case scratch directory, named by the process id so parallel workers do not collide
+struct ScratchDirectory
+{
+   enum { kMaxPath = 512 };
+
+   // What the case left in the directory
+   struct Leftovers
+   {
+      long long Bytes;
+      int       Files;
+   };
+
+   ScratchDirectory() { m_path.StorageBuf[0] = 0; }
+
+   bool Exists() const { return !m_path.Empty(); }
+   const char* Path() const { return m_path.CData(); }
+
+   const char* Create(Ordinal_t ordinal)
+   {
+      if (Exists())
+         return Path();
+
+#if defined(TESTED_SCRATCH_SUPPORTED)
+      const char* tmpDir = getenv("TMPDIR");
+      const char* root = access("/dev/shm", W_OK) == 0 ? "/dev/shm" 
+         : (tmpDir != nullptr && tmpDir[0] != 0 ? tmpDir : "/tmp");
+
+      snprintf(m_path.Data(), m_path.MaxSize(), "%s/tested.%d.%d.XXXXXX", root, 
+         static_cast<int>(getpid()), ordinal);
+      if (mkdtemp(m_path.Data()) == nullptr)
+      {
+         m_path.StorageBuf[0] = 0;
+         Fail("Failed to create scratch directory");
+      }
+      return Path();
+#else
+      (void)ordinal;
+      Fail("Scratch directory is not supported on this platform");
+      return nullptr;
+#endif
+   }
+
+   // Removes the directory with all the content and counts what was there
+   Leftovers Remove()
+   {
+      Leftovers leftovers = { 0, 0 };
+      if (!Exists())
+         return leftovers;
+
+#if defined(TESTED_SCRATCH_SUPPORTED)
+      char path[kMaxPath];
+      snprintf(path, sizeof(path), "%s", Path());
+      RemoveTree(path, leftovers);
+#endif
+      m_path.StorageBuf[0] = 0;
+      return leftovers;
+   }
+
+private:
+#if defined(TESTED_SCRATCH_SUPPORTED)
+   // The path buffer is extended in place for the entries, the recursion is bounded by kMaxPath
+   static void RemoveTree(char (&path)[kMaxPath], Leftovers& leftovers)
+   {
+      const size_t length = strlen(path);
+      DIR* dir = opendir(path);
+      if (dir != nullptr)
+      {
+         while (const dirent* entry = readdir(dir))
+         {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+               continue;
+
+            if (length + 1 + strlen(entry->d_name) >= kMaxPath)
+               continue;
+            snprintf(path + length, kMaxPath - length, "/%s", entry->d_name);
+
+            struct stat info;
+            if (lstat(path, &info) == 0)
+            {
+               if (S_ISDIR(info.st_mode))
+               {
+                  RemoveTree(path, leftovers);
+               }
+               else
+               {
+                  leftovers.Bytes += info.st_size;
+                  leftovers.Files += 1;
+                  unlink(path);
+               }
+            }
+            path[length] = 0;
+         }
+         closedir(dir);
+      }
+      rmdir(path);
+   }
+#endif
+
+   StringStorage<kMaxPath> m_path;
+};
+
 // Pointer to test case function
 typedef void (*CaseProc_t)(IRuntime*);
 
@@ -269,6 +717,7 @@ struct CaseListEntry final
    CaseListEntry* Next;
    CaseProc_t     CaseProc;
    Ordinal_t      Ordinal;
+   const GeneratedCase* Generated; // nullptr for Case<N> specialization
 };
 
 // 
@@ -279,15 +728,53 @@ struct GroupListEntry
    const char*     FileName;
    CaseListEntry*  CaseListHead;
 
+   // Optional group fixture, the storage is static memory of the Group<N, FixtureT> object
+   void*           FixtureStorage;
+   void*         (*FixtureCreate)(void* storage);
+   void          (*FixtureDestroy)(void* fixture);
+   const void*     FixtureTypeId;
+   void*           Fixture; // constructed instance or nullptr
+
+   // Generated group makes its case list on the first iteration over it, see GeneratedGroup
+   void          (*GenerateCases)(GroupListEntry* group);
+
    GroupListEntry(const char* name, const char* fileName)
-      : Next(nullptr), Name(name), FileName(fileName), CaseListHead(nullptr)
+      : Next(nullptr), Name(name), FileName(fileName), CaseListHead(nullptr),
+        FixtureStorage(nullptr), FixtureCreate(nullptr), FixtureDestroy(nullptr),
+        FixtureTypeId(nullptr), Fixture(nullptr), GenerateCases(nullptr)
    {}
+
+   void EnsureCases()
+   {
+      if (GenerateCases == nullptr)
+         return;
+      void (*generate)(GroupListEntry*) = GenerateCases;
+      GenerateCases = nullptr;
+      generate(this);
+   }
+
+   bool HasFixture() const { return FixtureCreate != nullptr; }
+
+   void CreateFixture()
+   {
+      if (Fixture == nullptr && HasFixture())
+         Fixture = FixtureCreate(FixtureStorage);
+   }
+
+   void DestroyFixture()
+   {
+      if (Fixture == nullptr)
+         return;
+      void* fixture = Fixture;
+      Fixture = nullptr;
+      FixtureDestroy(fixture);
+   }
 };
 
 // Subset: a reference to the tests
 struct Subset
 {
-   Subset() : m_isCollectFailed(false)  {}
+   Subset() : m_isCollectFailed(false), m_asyncLimit(INT_MAX)  {}
 
    struct NameFilter
    {
@@ -305,21 +792,55 @@ struct Subset
       };
 
       FilterType_t FilterType;
-      union
+
+      // StringStorage has a constructor, so these cannot share an anonymous union
+      StringStorage<kMaxCaseName> m_caseNameFilter;
+      StringStorage<kMaxGroupName> m_groupNameFilter;
+      Ordinal_t m_caseNumberFilter;
+      StringStorage<kMaxCaseAddress> m_addressFilter;
+
+      // Row of the table case from 'group:case[row]' address or -1, or the type of the typed 
+      // case from 'group:case<type>' address
+      int m_rowFilter;
+      StringStorage<kMaxCaseName> m_rowNameFilter;
+
+      bool HasRowFilter() const { return m_rowFilter >= 0 || !m_rowNameFilter.Empty(); }
+
+      // Groups or cases are split between shards by their order, see Subset::Shard()
+      unsigned m_shardIndex;
+      unsigned m_shardCount;
+      bool     m_shardByCase;
+
+      NameFilter() 
+         : FilterType(), m_rowFilter(-1), m_shardIndex(0), m_shardCount(1), m_shardByCase(false) 
+      {}
+
+      void Shard(unsigned index, unsigned count, bool byCase)
       {
-         struct
-         {
-            StringStorage<kMaxCaseName> m_caseNameFilter;
-            StringStorage<kMaxGroupName> m_groupNameFilter;
-            Ordinal_t m_caseNumberFilter;
-         };
-         struct
-         {
-            StringStorage<kMaxCaseAddress> m_addressFilter;
-         };
-      };
+         m_shardIndex = index;
+         m_shardCount = count;
+         m_shardByCase = byCase;
+      }
+
+      bool GroupExcludedByShard(unsigned groupIndex) const
+      {
+         return !m_shardByCase && m_shardCount > 1 && groupIndex % m_shardCount != m_shardIndex;
+      }
 
-      NameFilter() : FilterType() {}
+      // Each started case or table row is the unit which runs in one of the shards
+      bool UnitExcludedByShard(unsigned unitIndex) const
+      {
+         return m_shardByCase && m_shardCount > 1 && unitIndex % m_shardCount != m_shardIndex;
+      }
+
+      bool RowExcluded(size_t row, const char* const* rowNames) const
+      {
+         if (m_rowFilter >= 0 && row != static_cast<size_t>(m_rowFilter))
+            return true;
+         if (!m_rowNameFilter.Empty())
+            return rowNames == nullptr || strcmp(rowNames[row], m_rowNameFilter.CData()) != 0;
+         return false;
+      }
 
       void ByGroupName(std::string_view groupName)
       {
@@ -341,6 +862,61 @@ struct Subset
          m_caseNumberFilter = caseNumber;
       }
 
+      // Address is 'group', 'group:*', 'group:caseName' or 'group:caseNumber', the case can 
+      // have the row of table case as 'group:caseName[row]'
+      void ByAddress(std::string_view address)
+      {
+         m_rowFilter = -1;
+         m_rowNameFilter.Assign(std::string_view());
+         const size_t typeStart = address.find('<', address.find(':'));
+         if (address.size() > 2 && address.back() == '>' && typeStart != std::string_view::npos)
+         {
+            m_rowNameFilter.Assign(address.substr(typeStart + 1, address.size() - typeStart - 2));
+            address = address.substr(0, typeStart);
+         }
+         else if (address.size() > 2 && address.back() == ']')
+         {
+            const size_t bracket = address.rfind('[');
+            const std::string_view row = address.substr(bracket + 1, address.size() - bracket - 2);
+            if (bracket != std::string_view::npos && !row.empty() && row.size() <= 9 &&
+               row.find_first_not_of("0123456789") == std::string_view::npos)
+            {
+               int rowNumber = 0;
+               for (char digit : row)
+                  rowNumber = rowNumber * 10 + (digit - '0');
+               m_rowFilter = rowNumber;
+               address = address.substr(0, bracket);
+            }
+         }
+
+         const size_t colon = address.find(':');
+         if (colon == std::string_view::npos)
+         {
+            ByGroupName(address);
+            return;
+         }
+
+         const std::string_view groupName = address.substr(0, colon);
+         const std::string_view casePart = address.substr(colon + 1);
+         if (casePart.empty() || casePart == "*")
+         {
+            ByGroupName(groupName);
+            return;
+         }
+
+         if (casePart.find_first_not_of("0123456789") == std::string_view::npos
+            && casePart.length() <= 3)
+         {
+            int caseNumber = 0;
+            for (char digit : casePart)
+               caseNumber = caseNumber * 10 + (digit - '0');
+            ByGroupNameAndCaseNumber(groupName, static_cast<Ordinal_t>(caseNumber));
+            return;
+         }
+
+         ByGroupNameAndCaseName(groupName, casePart);
+      }
+
       bool CaseExcludedByName(const char* caseName) const
       {
          if (FilterType != FilterType_GroupNameCaseName)
@@ -385,7 +961,7 @@ struct Subset
       enum EventType_t { EventType_Group, EventType_Case, EventType_Done };
 
       Iterator(GroupListEntry *startGroupItem, const NameFilter* nameFilter) 
-         : m_currentGroup(startGroupItem), m_nameFilter(nameFilter)
+         : m_currentGroup(startGroupItem), m_nameFilter(nameFilter), m_groupIndex(0)
       {
          if (m_currentGroup == nullptr)
          {
@@ -397,7 +973,7 @@ struct Subset
             m_eventState = EventType_Group;
 
             // If there is a filter find the first group that matches it
-            if (nameFilter->GroupExcludedByFilter(m_currentGroup->Name))
+            if (GroupExcluded())
                NextGroup();
          }
       }
@@ -411,11 +987,13 @@ struct Subset
             { 
                const char* Name; 
                const char* FileName;
+               GroupListEntry* Entry;
             } Group;
             struct
             {
                CaseProc_t     CaseProc;
                Ordinal_t      Ordinal;
+               const GeneratedCase* Generated;
             } Case;
          };
 
@@ -430,6 +1008,7 @@ struct Subset
 
          if (m_eventState == EventType_Group)
          {
+            m_currentGroup->EnsureCases();
             m_currentCase = m_currentGroup->CaseListHead;
 
             // if there are no tests in the current group we can start move to a next group
@@ -460,12 +1039,14 @@ struct Subset
          {
             currentEvent.Group.Name = m_currentGroup->Name;
             currentEvent.Group.FileName = m_currentGroup->FileName;
+            currentEvent.Group.Entry = m_currentGroup;
          }
 
          if (m_eventState == EventType_Case)
          {
             currentEvent.Case.CaseProc = m_currentCase->CaseProc;
             currentEvent.Case.Ordinal = m_currentCase->Ordinal;
+            currentEvent.Case.Generated = m_currentCase->Generated;
          }
 
          return currentEvent;
@@ -473,17 +1054,25 @@ struct Subset
 
    private:
 
+      bool GroupExcluded() const
+      {
+         return m_nameFilter->GroupExcludedByFilter(m_currentGroup->Name)
+            || m_nameFilter->GroupExcludedByShard(m_groupIndex);
+      }
+
       void NextGroup()
       {
          m_currentGroup = m_currentGroup->Next;
+         m_groupIndex += 1;
          while (m_currentGroup != nullptr)
          {
-            if (!m_nameFilter->GroupExcludedByFilter(m_currentGroup->Name))
+            if (!GroupExcluded())
             {
                m_eventState = EventType_Group;
                return;
             }
             m_currentGroup = m_currentGroup->Next;
+            m_groupIndex += 1;
          }
 
          m_eventState = EventType_Done;
@@ -513,6 +1102,7 @@ struct Subset
       CaseListEntry  *m_currentCase;
       const NameFilter *m_nameFilter;
       EventType_t     m_eventState;
+      unsigned        m_groupIndex; // position in the list of all groups, used for sharding
    };
 
    struct Stats
@@ -538,10 +1128,74 @@ struct Subset
       {
          const char* Name;
          Ordinal_t   Ordinal;
+         int         Row;     // row of the table case or -1
+         const char* RowName; // type of the typed case or nullptr
+         bool        CompileTime; // checked by the compiler, see StartCompileTimeCase()
       };
 
       virtual void OnCaseStart(StartedCase caseInfo) = 0;
       virtual void OnCaseDone(CaseResult_t code, const char* message = nullptr) = 0;
+
+      // Shared resource was built by the request of the current case. It can be invoked from 
+      // any thread of the case.
+      virtual void OnResourceBuilt(const char* resourceName, double milliseconds) {}
+
+      // The case finished with files in its scratch directory, they are removed anyway
+      virtual void OnScratchLeftovers(long long bytes, int files) {}
+
+      // The case spent real time in sleeps (nanosleep, usleep...) which tested::Clock could 
+      // skip, it comes before OnCaseDone(). See SleepMeter.
+      virtual void OnCaseSlept(double milliseconds) {}
+   };
+
+   // Each case can declare a few resources it uses
+   enum { kMaxCaseResources = 8 };
+
+   // The async case in flight after its body returned, it keeps the resources and the scratch
+   // directory until it is complete
+   struct AsyncCase
+   {
+      unsigned                  Generation;
+      bool                      Busy;
+      IRunObserver::StartedCase Started;
+      ResourceEntry*            Declared[kMaxCaseResources];
+      int                       DeclaredCount;
+      ScratchDirectory          Scratch;
+      long long                 SleptNs;
+   };
+
+   // The event loop of the async cases and the slots of the cases in flight, implemented by the
+   // backend (see AsyncRunner in tested_async.h) which installs itself. The runtime calls it 
+   // from the thread which runs the cases.
+   struct IAsyncBackend
+   {
+      // The run starts, the results of the async cases go to the owners. Returns the owners of 
+      // the enclosing run, Detach() restores them when the run is over.
+      virtual IAsyncOwners* Attach(IAsyncOwners* owners) = 0;
+      virtual void Detach(IAsyncOwners* previous) = 0;
+
+      virtual AsyncCase* Cases() = 0;
+      virtual unsigned MaxCases() const = 0;
+
+      // The watches and timers registered from now on belong to the async case, 0 is none
+      virtual void SetCurrentOwner(unsigned owner) = 0;
+      // The current owner fails unless it is complete in timeoutMs
+      virtual void SetTimeout(int timeoutMs) = 0;
+      // The case is over, its watches and timers are dropped
+      virtual void CancelOwner(unsigned owner) = 0;
+      // Waits for the events of the cases in flight once, false if there is nothing to wait for
+      virtual bool RunOnce() = 0;
+
+      // Real sleeps of the cases so far, see SleepMeter
+      virtual long long SleptNs() const = 0;
+      // Real sleeps of the running callback not yet added to its case
+      virtual long long TakeSlept() = 0;
+
+      static IAsyncBackend*& Installed()
+      {
+         static IAsyncBackend* s_backend = nullptr;
+         return s_backend;
+      }
    };
 
    struct ICaseExporter
@@ -551,6 +1205,9 @@ struct Subset
          const char* CaseName;
          Ordinal_t   CaseNumber;
          CaseProc_t  CaseProc;
+         int         Row;     // row of the table case or -1, address is 'group:CaseName[Row]'
+         const char* RowName; // type of the typed case, address is 'group:CaseName<RowName>'
+         bool        CompileTime; // checked by the compiler, see StartCompileTimeCase()
       };
 
       // App can throw this in one of the handles below and export would be stopped
@@ -589,7 +1246,7 @@ struct Subset
             exporter->OnGroup(ev.Group.Name, ev.Group.FileName);
 
          if (ev.Type == Iterator::EventType_Case)
-            runtime.ExportOneCase(ev.Case.CaseProc, ev.Case.Ordinal);
+            runtime.ExportOneCase(ev.Case.CaseProc, ev.Case.Ordinal, ev.Case.Generated);
 
          it.Next();
       }
@@ -597,68 +1254,619 @@ struct Subset
       exporter->OnDone();
    }
 
+   // The part of this subset for the shard 'index' of 'count', e.g. for one of parallel worker
+   // processes. By default groups are not split, so group fixture is still constructed once. 
+   // With byCase the cases and rows of table cases are distributed between shards evenly, 
+   // and group fixture is constructed in each shard which runs a case of the group.
+   Subset Shard(unsigned index, unsigned count, bool byCase = false) const
+   {
+      Subset res = (*this);
+      res.m_nameFilter.Shard(index, count, byCase);
+      return res;
+   }
+
+   // At most maxCases async cases are in flight at once, the next one waits for a free slot. 
+   // 1 runs them one by one. There are no more of them than the slots of IAsyncBackend.
+   Subset LimitAsync(int maxCases) const
+   {
+      Subset res = (*this);
+      res.m_asyncLimit = maxCases < 1 ? 1 : maxCases;
+      return res;
+   }
+
+   // Builds in advance the shared resources used by the cases of this subset. They are kept 
+   // until ReleaseBuiltResources(), so e.g. forked workers share the pages copy-on-write.
+   void BuildResources(IRunObserver* observer = nullptr)
+   {
+      CountResourceUsers();
+
+      std::lock_guard<std::mutex> lock(ResourceEntry::Lock());
+      for (ResourceEntry* entry = ResourceEntry::ListHead(); entry != nullptr; entry = entry->Next)
+      {
+         if (entry->Users > 0)
+         {
+            BuildResource(*entry, observer);
+            entry->Pinned = true;
+         }
+         entry->Users = 0;
+      }
+   }
+
+   static void ReleaseBuiltResources()
+   {
+      std::lock_guard<std::mutex> lock(ResourceEntry::Lock());
+      for (ResourceEntry* entry = ResourceEntry::ListHead(); entry != nullptr; entry = entry->Next)
+      {
+         entry->Pinned = false;
+         entry->Release();
+      }
+   }
+
 
 private:
    Stats RunParamChecked(IRunObserver* testRunProgress) 
    {
+      CountResourceUsers();
+
       Iterator it(m_groupListHead, &m_nameFilter);
-      Runtime runtime(testRunProgress, &m_nameFilter);
+      Runtime runtime(testRunProgress, &m_nameFilter, m_asyncLimit);
 
-      while(true)
+      try
       {
-         const Iterator::Event ev = it.Get();
-         if (ev.Type == Iterator::EventType_Done)
-            break;
+         while(true)
+         {
+            const Iterator::Event ev = it.Get();
+            if (ev.Type == Iterator::EventType_Done)
+               break;
 
-         if (ev.Type == Iterator::EventType_Group)
-            testRunProgress->OnGroupStart(ev.Group.Name);
+            if (ev.Type == Iterator::EventType_Group)
+            {
+               runtime.EnterGroup(ev.Group.Entry);
+               testRunProgress->OnGroupStart(ev.Group.Name);
+            }
 
-         if (ev.Type == Iterator::EventType_Case)
-            runtime.RunOneCase(ev.Case.CaseProc, ev.Case.Ordinal);
+            if (ev.Type == Iterator::EventType_Case)
+               runtime.RunOneCase(ev.Case.CaseProc, ev.Case.Ordinal, ev.Case.Generated);
 
-         it.Next();
+            it.Next();
+         }
+         runtime.DrainAsync();
+      }
+      catch (...)
+      {
+         runtime.AbandonAsync();
+         runtime.EnterGroup(nullptr);
+         ReleaseResources();
+         throw;
       }
 
+      runtime.EnterGroup(nullptr);
+      ReleaseResources();
       return runtime.m_result;
    }
 
-   struct Runtime final: IRuntime
+   // Runs selected cases up to StartCase() to learn how many of them use each shared resource
+   void CountResourceUsers()
    {
-      IRunObserver* m_runObserver;
-      Ordinal_t     m_currentTestOrdinal;
-      const char*   m_caseNameFilter;
-      Stats         m_result;
-      NameFilter   *m_pNameFilterRef;
-
-      Runtime(IRunObserver* progressEvents, NameFilter* pNameFilterRef)
-         : m_runObserver(progressEvents), m_pNameFilterRef(pNameFilterRef)
+      UsersRuntime runtime(&m_nameFilter);
+      for (Iterator it(m_groupListHead, &m_nameFilter); it.Get().Type != Iterator::EventType_Done; 
+         it.Next())
       {
+         const Iterator::Event ev = it.Get();
+         if (ev.Type == Iterator::EventType_Case)
+            runtime.CountOneCase(ev.Case.CaseProc, ev.Case.Generated);
       }
+   }
+
+   // Builds the resource if it is not yet built, the caller holds the lock
+   static void* BuildResource(ResourceEntry& resource, IRunObserver* observer)
+   {
+      if (resource.Instance == nullptr)
+      {
+         const auto start = std::chrono::steady_clock::now();
+         resource.Instance = resource.Create(resource.Storage);
+         const std::chrono::duration<double, std::milli> buildTime = 
+            std::chrono::steady_clock::now() - start;
+         if (observer != nullptr)
+            observer->OnResourceBuilt(resource.Name ? resource.Name : "", buildTime.count());
+      }
+      return resource.Instance;
+   }
+
+   // Tears down resources which are still alive when the run is over or interrupted
+   static void ReleaseResources()
+   {
+      std::lock_guard<std::mutex> lock(ResourceEntry::Lock());
+      for (ResourceEntry* entry = ResourceEntry::ListHead(); entry != nullptr; entry = entry->Next)
+      {
+         entry->Release();
+         entry->Users = 0;
+      }
+   }
+
+   struct UsersRuntime final: IRuntime
+   {
+      NameFilter*    m_nameFilter;
+      ResourceEntry* m_declared[kMaxCaseResources];
+      int            m_declaredCount;
+      unsigned       m_unitIndex;    // the same count as Runtime::m_unitIndex, for sharding
+
+      UsersRuntime(NameFilter* nameFilter)
+         : m_nameFilter(nameFilter), m_declaredCount(0), m_unitIndex(0)
+      {}
 
       void StartCase(const char* testName, const char* description = nullptr) final
+      {
+         if (m_nameFilter->CaseExcludedByName(testName) || m_nameFilter->HasRowFilter())
+            throw CaseFiltered();
+         if (m_nameFilter->UnitExcludedByShard(m_unitIndex++))
+            throw CaseFiltered();
+         CountUsers(1);
+      }
+
+      // Each row is invoked separately and releases the resources when done, the rows of
+      // other shards do not use them
+      size_t StartRow(const char* testName, size_t rowCount, const char* const* rowNames,
+         const char* description) final
+      {
+         if (m_nameFilter->CaseExcludedByName(testName))
+            throw CaseFiltered();
+
+         size_t selectedRows = 0;
+         for (size_t row = 0; row < rowCount; ++row)
+         {
+            if (!m_nameFilter->RowExcluded(row, rowNames) && 
+               !m_nameFilter->UnitExcludedByShard(m_unitIndex++))
+               ++selectedRows;
+         }
+         CountUsers(selectedRows);
+         return 0;
+      }
+
+      void CountUsers(size_t invocations)
+      {
+         std::lock_guard<std::mutex> lock(ResourceEntry::Lock());
+         for (int i = 0; i < m_declaredCount; ++i)
+            m_declared[i]->Users += static_cast<int>(invocations);
+         throw CaseIsReal();
+      }
+
+      void DeclareResource(ResourceEntry& resource) final
+      {
+         if (m_declaredCount < kMaxCaseResources)
+            m_declared[m_declaredCount++] = &resource;
+      }
+
+      void CountOneCase(CaseProc_t caseProc, const GeneratedCase* generated)
+      {
+         m_declaredCount = 0;
+         m_generatedCase = generated;
+         try
+         {
+            caseProc(this);
+         }
+         catch (...)
+         {
+            // the case does not start with StartCase() or filtered, export reports it
+         }
+      }
+   };
+
+   struct Runtime final: IRuntime, IAsyncOwners
+   {
+      IRunObserver* m_runObserver;
+      Ordinal_t     m_currentTestOrdinal;
+      const char*   m_caseNameFilter;
+      Stats         m_result;
+      NameFilter   *m_pNameFilterRef;
+      GroupListEntry* m_currentGroup;
+      ResourceEntry*  m_declared[kMaxCaseResources];
+      int             m_declaredCount;
+      bool            m_caseStarted;
+      ScratchDirectory m_scratch;
+      size_t          m_currentRow;   // row of the table case to run in this invocation
+      size_t          m_rowCount;     // rows of the table case, 0 for regular case
+      unsigned        m_unitIndex;    // started cases and rows, for sharding by case
+      unsigned        m_asyncOwner;   // the async case which body runs now, 0 for none
+      int             m_asyncCount;   // async cases in flight including the one in the body
+      int             m_asyncLimit;
+      bool            m_bodyDone;     // the async case was complete before its body returned
+      CaseResult_t    m_bodyCode;
+      StringStorage<1024> m_bodyMessage;
+      IAsyncBackend*  m_async;        // nullptr without tested_async.h
+      IAsyncOwners*   m_previousOwners;
+      long long       m_bodySleptSince;
+
+      Runtime(IRunObserver* progressEvents, NameFilter* pNameFilterRef, int asyncLimit)
+         : m_runObserver(progressEvents), m_pNameFilterRef(pNameFilterRef),
+           m_currentGroup(nullptr), m_declaredCount(0), m_caseStarted(false),
+           m_currentRow(0), m_rowCount(0), m_unitIndex(0), m_asyncOwner(0), m_asyncCount(0),
+           m_asyncLimit(asyncLimit), m_bodyDone(false), m_bodyCode(CaseResult_Passed),
+           m_async(IAsyncBackend::Installed()), m_previousOwners(nullptr), m_bodySleptSince(0)
+      {
+         if (m_async != nullptr)
+         {
+            m_asyncLimit = (std::min)(asyncLimit, static_cast<int>(m_async->MaxCases()));
+            m_previousOwners = m_async->Attach(this);
+         }
+      }
+
+      ~Runtime()
+      {
+         if (m_async != nullptr)
+            m_async->Detach(m_previousOwners);
+      }
+
+      Runtime(const Runtime&) = delete;
+      Runtime& operator=(const Runtime&) = delete;
+
+      void StartCase(const char* testName, const char* description = nullptr) final
+      {
+         if (m_pNameFilterRef->CaseExcludedByName(testName) || m_pNameFilterRef->HasRowFilter())
+            throw CaseFiltered();
+
+         StartUnit(testName, -1, nullptr);
+      }
+
+      void StartCompileTime(const char* testName, const char* description = nullptr) final
+      {
+         if (m_pNameFilterRef->CaseExcludedByName(testName) || m_pNameFilterRef->HasRowFilter())
+            throw CaseFiltered();
+
+         StartUnit(testName, -1, nullptr, true);
+      }
+
+      // The start and the result of async case are reported together when it is complete
+      Completion StartAsyncCase(const char* testName, int timeoutMs, const char* description) final
+      {
+         if (m_pNameFilterRef->CaseExcludedByName(testName) || m_pNameFilterRef->HasRowFilter())
+            throw CaseFiltered();
+         if (m_async == nullptr)
+         {
+            StartUnit(testName, -1, nullptr);
+            Fail("Async case needs the event loop, see tested::AsyncRunner in tested_async.h");
+         }
+         if (m_pNameFilterRef->UnitExcludedByShard(m_unitIndex++))
+            throw CaseFiltered();
+
+         while (m_asyncCount >= m_asyncLimit)
+            WaitAsync();
+
+         AsyncCase* cases = m_async->Cases();
+         int slot = 0;
+         while (cases[slot].Busy)
+            ++slot;
+
+         AsyncCase& asyncCase = cases[slot];
+         asyncCase.Busy = true;
+         asyncCase.Generation += 1;
+         asyncCase.Started.Name = testName;
+         asyncCase.Started.Ordinal = m_currentTestOrdinal;
+         asyncCase.Started.Row = -1;
+         asyncCase.Started.RowName = nullptr;
+         asyncCase.Started.CompileTime = false;
+         asyncCase.DeclaredCount = 0;
+         asyncCase.SleptNs = 0;
+         m_asyncCount += 1;
+
+         const unsigned owner = AsyncOwner(static_cast<unsigned>(slot));
+         m_asyncOwner = owner;
+         m_bodyDone = false;
+         m_caseStarted = true;
+
+         m_async->SetCurrentOwner(owner);
+         if (timeoutMs > 0)
+            m_async->SetTimeout(timeoutMs);
+
+         if (m_currentGroup != nullptr)
+            m_currentGroup->CreateFixture();
+         return Completion(this, owner);
+      }
+
+      // The owner is the slot and its generation, so the late result of a complete case is ignored
+      unsigned AsyncOwner(unsigned slot) const
+      {
+         return ((m_async->Cases()[slot].Generation & 0x7FFFF) << 13) | (slot + 1);
+      }
+
+      AsyncCase* FindAsync(unsigned owner) const
+      {
+         const unsigned slot = owner & 8191;
+         if (m_async == nullptr || slot == 0 || slot > m_async->MaxCases())
+            return nullptr;
+         AsyncCase& asyncCase = m_async->Cases()[slot - 1];
+         return asyncCase.Busy && AsyncOwner(slot - 1) == owner ? &asyncCase : nullptr;
+      }
+
+      void Complete(unsigned owner, CaseResult_t code, std::string_view message) final
+      {
+         AsyncCase* asyncCase = FindAsync(owner);
+         if (asyncCase == nullptr)
+            return;
+
+         // The body is still running, the result is reported when it returns
+         if (owner == m_asyncOwner)
+         {
+            if (!m_bodyDone)
+            {
+               m_bodyDone = true;
+               m_bodyCode = code;
+               m_bodyMessage = StringStorage<1024>(message);
+            }
+            return;
+         }
+
+         const StringStorage<1024> text(message);
+         asyncCase->SleptNs += m_async->TakeSlept();
+         m_runObserver->OnCaseStart(asyncCase->Started);
+         CountResult(code, text.Empty() ? nullptr : text.CData(), asyncCase->SleptNs);
+         FreeAsync(owner, *asyncCase, true);
+      }
+
+      void AddSleep(unsigned owner, long long nanoseconds) final
+      {
+         if (AsyncCase* asyncCase = FindAsync(owner))
+            asyncCase->SleptNs += nanoseconds;
+      }
+
+      bool IsDone(unsigned owner) const final
+      {
+         return FindAsync(owner) == nullptr || (owner == m_asyncOwner && m_bodyDone);
+      }
+
+      // The case is over: its callbacks are dropped, the scratch directory and resources freed
+      void FreeAsync(unsigned owner, AsyncCase& asyncCase, bool detached)
+      {
+         m_async->CancelOwner(owner);
+         if (detached)
+         {
+            const ScratchDirectory::Leftovers leftovers = asyncCase.Scratch.Remove();
+            if (leftovers.Files != 0)
+               m_runObserver->OnScratchLeftovers(leftovers.Bytes, leftovers.Files);
+
+            std::lock_guard<std::mutex> lock(ResourceEntry::Lock());
+            for (int i = 0; i < asyncCase.DeclaredCount; ++i)
+            {
+               ResourceEntry* resource = asyncCase.Declared[i];
+               if (resource->Users > 0 && --resource->Users == 0)
+                  resource->Release();
+            }
+         }
+         asyncCase.DeclaredCount = 0;
+         asyncCase.Busy = false;
+         m_asyncCount -= 1;
+      }
+
+      // The body of async case returned, the case goes on in the event loop with its resources
+      void DetachAsync()
+      {
+         const unsigned owner = m_asyncOwner;
+         m_asyncOwner = 0;
+         m_async->SetCurrentOwner(0);
+
+         AsyncCase& asyncCase = *FindAsync(owner);
+         if (m_bodyDone)
+         {
+            m_runObserver->OnCaseStart(asyncCase.Started);
+            CountResult(m_bodyCode, m_bodyMessage.Empty() ? nullptr : m_bodyMessage.CData(),
+               BodySlept());
+            FreeAsync(owner, asyncCase, false);
+            RemoveScratch();
+            ReleaseCaseResources();
+            return;
+         }
+
+         std::copy(m_declared, m_declared + m_declaredCount, asyncCase.Declared);
+         asyncCase.DeclaredCount = m_declaredCount;
+         asyncCase.SleptNs = BodySlept();
+         asyncCase.Scratch = m_scratch;
+         m_scratch = ScratchDirectory();
+         m_declaredCount = 0;
+         m_caseStarted = false;
+      }
+
+      // Runs the event loop once, the cases which have nothing to wait for fail
+      void WaitAsync()
+      {
+         if (m_async->RunOnce())
+            return;
+
+         AsyncCase* cases = m_async->Cases();
+         for (unsigned slot = 0; slot < m_async->MaxCases(); ++slot)
+         {
+            if (cases[slot].Busy)
+               Complete(AsyncOwner(slot), CaseResult_Failed,
+                  "Async case has nothing to wait for and is not complete");
+         }
+      }
+
+      void DrainAsync()
+      {
+         while (m_asyncCount > 0)
+            WaitAsync();
+      }
+
+      // The run is interrupted, cases in flight are dropped without the results
+      void AbandonAsync()
+      {
+         if (m_async == nullptr)
+            return;
+
+         AsyncCase* cases = m_async->Cases();
+         for (unsigned slot = 0; slot < m_async->MaxCases() && m_asyncCount > 0; ++slot)
+         {
+            if (cases[slot].Busy)
+               FreeAsync(AsyncOwner(slot), cases[slot], true);
+         }
+         m_asyncOwner = 0;
+         m_async->SetCurrentOwner(0);
+      }
+
+      void CountResult(CaseResult_t code, const char* message, long long sleptNs)
+      {
+         if (sleptNs > 0)
+            m_runObserver->OnCaseSlept(static_cast<double>(sleptNs) / 1e6);
+         m_runObserver->OnCaseDone(code, message);
+         switch (code)
+         {
+         case CaseResult_Passed:  m_result.Passed += 1;  break;
+         case CaseResult_Failed:  m_result.Failed += 1;  break;
+         case CaseResult_Skipped: m_result.Skipped += 1; break;
+         }
+      }
+
+      // The result of the case body, the async case in the body records it
+      void ReportBody(CaseResult_t code, const char* message = nullptr)
+      {
+         if (m_asyncOwner != 0)
+            Complete(m_asyncOwner, code, message != nullptr ? message : "");
+         else
+            CountResult(code, message, BodySlept());
+      }
+
+      // Real sleeps since the body of the case started
+      long long BodySlept() const 
+      { 
+         return m_async != nullptr ? m_async->SleptNs() - m_bodySleptSince : 0; 
+      }
+
+      size_t StartRow(const char* testName, size_t rowCount, const char* const* rowNames,
+         const char* description) final
       {
          if (m_pNameFilterRef->CaseExcludedByName(testName))
             throw CaseFiltered();
 
+         // The row from the address is the only one to run
+         m_rowCount = rowCount;
+         const int rowFilter = m_pNameFilterRef->m_rowFilter;
+         if (rowFilter >= 0 && m_currentRow < static_cast<size_t>(rowFilter))
+            m_currentRow = rowFilter;
+         if (m_currentRow >= rowCount || m_pNameFilterRef->RowExcluded(m_currentRow, rowNames))
+            throw CaseFiltered();
+
+         StartUnit(testName, static_cast<int>(m_currentRow), 
+            rowNames != nullptr ? rowNames[m_currentRow] : nullptr);
+         return m_currentRow;
+      }
+
+      void StartUnit(const char* testName, int row, const char* rowName, bool compileTime = false)
+      {
+         if (m_pNameFilterRef->UnitExcludedByShard(m_unitIndex++))
+            throw CaseFiltered();
+
+         // The time the case takes would count against the timeouts of the async cases in 
+         // flight, with tested::Clock it may jump past them
+         DrainAsync();
+
          IRunObserver::StartedCase startedCase;
          startedCase.Name = testName;
          startedCase.Ordinal = m_currentTestOrdinal;
+         startedCase.Row = row;
+         startedCase.RowName = rowName;
+         startedCase.CompileTime = compileTime;
          m_runObserver->OnCaseStart(startedCase);
+         m_caseStarted = true;
+
+         // The fixture is created by the first case selected to run, so a group which has 
+         // all cases filtered out does not pay for it. Exception here fails the case.
+         if (m_currentGroup != nullptr)
+            m_currentGroup->CreateFixture();
       }
 
-      void RunOneCase(CaseProc_t caseProc, Ordinal_t ordinal)
+      void* GetGroupFixture(const void* typeId) final
       {
+         if (m_currentGroup == nullptr || m_currentGroup->Fixture == nullptr)
+            Fail("The group of the case has no fixture");
+         if (m_currentGroup->FixtureTypeId != typeId)
+            Fail("The group fixture has different type");
+         return m_currentGroup->Fixture;
+      }
+
+      void DeclareResource(ResourceEntry& resource) final
+      {
+         if (m_declaredCount == kMaxCaseResources)
+            Fail("Too many shared resources declared by the case");
+         m_declared[m_declaredCount++] = &resource;
+      }
+
+      void* AcquireResource(ResourceEntry& resource) final
+      {
+         if (std::find(m_declared, m_declared + m_declaredCount, &resource) == 
+            m_declared + m_declaredCount)
+            Fail("Shared resource must be declared by UseResource() before StartCase()");
+
+         std::lock_guard<std::mutex> lock(ResourceEntry::Lock());
+         return BuildResource(resource, m_runObserver);
+      }
+
+      const char* GetScratchDir() final
+      {
+         return m_scratch.Create(m_currentTestOrdinal);
+      }
+
+      void RemoveScratch()
+      {
+         const ScratchDirectory::Leftovers leftovers = m_scratch.Remove();
+         if (leftovers.Files != 0)
+            m_runObserver->OnScratchLeftovers(leftovers.Bytes, leftovers.Files);
+      }
+
+      // The case is done, the resources it declared are destroyed if it was the last user
+      void ReleaseCaseResources()
+      {
+         if (m_caseStarted)
+         {
+            std::lock_guard<std::mutex> lock(ResourceEntry::Lock());
+            for (int i = 0; i < m_declaredCount; ++i)
+            {
+               if (m_declared[i]->Users > 0 && --m_declared[i]->Users == 0)
+                  m_declared[i]->Release();
+            }
+         }
+         m_declaredCount = 0;
+         m_caseStarted = false;
+      }
+
+      // Destroys the fixture of previous group when the run moves to the next group
+      void EnterGroup(GroupListEntry* group)
+      {
+         // Async cases may use the fixture until they are complete, and their results are
+         // reported under their own group, so they are complete before the next one starts
+         if (m_currentGroup != nullptr)
+            DrainAsync();
+         if (m_currentGroup != nullptr)
+            m_currentGroup->DestroyFixture();
+         m_currentGroup = group;
+      }
+
+      // Regular case is invoked once, table case once for each row
+      void RunOneCase(CaseProc_t caseProc, Ordinal_t ordinal, const GeneratedCase* generated)
+      {
+         m_generatedCase = generated;
+         m_currentRow = 0;
+         m_rowCount = 0;
+         do
+         {
+            RunOneInvocation(caseProc, ordinal);
+            m_currentRow += 1;
+         }
+         while (m_currentRow < m_rowCount);
+      }
+
+      void RunOneInvocation(CaseProc_t caseProc, Ordinal_t ordinal)
+      {
+         m_asyncOwner = 0;
+         m_bodySleptSince = m_async != nullptr ? m_async->SleptNs() : 0;
          try
          {
             m_currentTestOrdinal = ordinal;
             caseProc(this);
-            m_runObserver->OnCaseDone(CaseResult_Passed);
-            m_result.Passed += 1;
+            if (m_asyncOwner == 0)
+               CountResult(CaseResult_Passed, nullptr, BodySlept());
          }
          catch (CaseSkipped)
          {
-            m_runObserver->OnCaseDone(CaseResult_Skipped);
-            m_result.Skipped += 1;
+            ReportBody(CaseResult_Skipped);
          }
          catch (CaseFiltered)
          {
@@ -668,22 +1876,30 @@ private:
          }
          catch (const CaseFailed& ex)
          {
-            m_runObserver->OnCaseDone(CaseResult_Failed, ex.Message.CData());
-            m_result.Failed += 1;
+            ReportBody(CaseResult_Failed, ex.Message.CData());
          }
          catch (ProcessCorruptedException& ex)
          {
             ex.Ordinal = ordinal;
+            m_scratch.Remove();
             throw ex; // handled by upper level
          }
          catch (std::exception& ex)
          {
-            m_runObserver->OnCaseDone(CaseResult_Failed, ex.what());
+            ReportBody(CaseResult_Failed, ex.what());
          }
          catch (...)
          {
-            m_runObserver->OnCaseDone(CaseResult_Failed, "Unknown exception");
+            ReportBody(CaseResult_Failed, "Unknown exception");
          }
+
+         if (m_asyncOwner != 0)
+         {
+            DetachAsync();
+            return;
+         }
+         RemoveScratch();
+         ReleaseCaseResources();
       }
    };
 
@@ -701,21 +1917,54 @@ private:
       {}
 
       void StartCase(const char* testName, const char* description = nullptr) final
+      {
+         if (m_nameFilter->CaseExcludedByName(testName) || m_nameFilter->HasRowFilter())
+            throw CaseFiltered();
+
+         ExportCase(testName, -1, nullptr);
+         throw CaseIsReal();
+      }
+
+      void StartCompileTime(const char* testName, const char* description = nullptr) final
+      {
+         if (m_nameFilter->CaseExcludedByName(testName) || m_nameFilter->HasRowFilter())
+            throw CaseFiltered();
+
+         ExportCase(testName, -1, nullptr, true);
+         throw CaseIsReal();
+      }
+
+      // Each row of the table case is exported as the sub-case
+      size_t StartRow(const char* testName, size_t rowCount, const char* const* rowNames,
+         const char* description) final
       {
          if (m_nameFilter->CaseExcludedByName(testName))
             throw CaseFiltered();
 
+         for (size_t row = 0; row < rowCount; ++row)
+         {
+            if (!m_nameFilter->RowExcluded(row, rowNames))
+               ExportCase(testName, static_cast<int>(row), rowNames ? rowNames[row] : nullptr);
+         }
+         throw CaseIsReal();
+      }
+
+      void ExportCase(const char* testName, int row, const char* rowName, bool compileTime = false)
+      {
          ICaseExporter::ExportedCase exportedCase;
          exportedCase.CaseName = testName;
          exportedCase.CaseNumber = m_currentTestOrdinal;
          exportedCase.CaseProc = m_currentCaseProc;
+         exportedCase.Row = row;
+         exportedCase.RowName = rowName;
+         exportedCase.CompileTime = compileTime;
 
          m_pExporter->OnCase(exportedCase);
-         throw CaseIsReal();
       }
 
-      void ExportOneCase(CaseProc_t caseProc, Ordinal_t ordinal)
+      void ExportOneCase(CaseProc_t caseProc, Ordinal_t ordinal, const GeneratedCase* generated)
       {
+         m_generatedCase = generated;
          try
          {
             m_currentTestOrdinal = ordinal;
@@ -743,8 +1992,9 @@ private:
    };
 
 
-private:
-   // The default progress reporter to stdout. It makes the tested.h usable without any backend.
+public:
+   // The default progress reporter to stdout. It makes the tested.h usable without any backend,
+   // backends that decorate the run observer can also chain to it.
    struct StdoutReporter final: IRunObserver  
    {
       void OnGroupStart(const char* groupName) override
@@ -756,7 +2006,25 @@ private:
       void OnCaseStart(StartedCase caseInfo) override
       {
          m_currentCase = caseInfo;
-         printf("%02d:%s...\n", caseInfo.Ordinal, caseInfo.Name);
+         PrintCase();
+         printf("...\n");
+      }
+
+      void OnResourceBuilt(const char* resourceName, double milliseconds) override
+      {
+         printf("   resource '%s' built in %.1f ms\n", resourceName, milliseconds);
+      }
+
+      void OnScratchLeftovers(long long bytes, int files) override
+      {
+         PrintCase();
+         printf(" left %d files, %lld bytes in scratch directory\n", files, bytes);
+      }
+
+      void OnCaseSlept(double milliseconds) override
+      {
+         PrintCase();
+         printf(" slept %.1f ms of real time\n", milliseconds);
       }
 
       void OnCaseDone(CaseResult_t code, const char* message) override
@@ -766,15 +2034,26 @@ private:
          if (code == CaseResult_Skipped && message != nullptr && message[0] != 0)
             printf("Case skipped: %s\n", message);
 
-         printf("%02d:%s", m_currentCase.Ordinal, m_currentCase.Name);
+         PrintCase();
          switch (code)
          {
-         case CaseResult_Passed:  printf(" PASSED\n");  break;
+         case CaseResult_Passed:
+            printf(m_currentCase.CompileTime ? " PASSED at compile time\n" : " PASSED\n");
+            break;
          case CaseResult_Failed:  printf(" FAILED\n");  break;
          case CaseResult_Skipped: printf(" SKIPPED\n"); break;
          }
       }
    private:
+      void PrintCase() const
+      {
+         printf("%02d:%s", m_currentCase.Ordinal, m_currentCase.Name);
+         if (m_currentCase.RowName != nullptr)
+            printf("<%s>", m_currentCase.RowName);
+         else if (m_currentCase.Row >= 0)
+            printf("[%d]", m_currentCase.Row);
+      }
+
       StartedCase m_currentCase;
    };
 
@@ -786,6 +2065,7 @@ protected:
    GroupListEntry* m_groupListTail;
 
    NameFilter m_nameFilter;
+   int m_asyncLimit;
    friend struct Storage;
 };
 
@@ -815,6 +2095,13 @@ struct Storage final: private Subset
       return res;
    }
 
+   Subset ByAddress(std::string_view address) const
+   {
+      Subset res = (*this);
+      res.m_nameFilter.ByAddress(address);
+      return res;
+   }
+
    void AddGroup(GroupListEntry* newGroupEntry)
    {
       if (m_groupListTail == nullptr)
@@ -840,8 +2127,40 @@ struct Storage final: private Subset
    }
 };
 
-// API to define the test group
-template <Ordinal_t N>
+// Defined below in the anonymous namespace, Group uses it as a default argument
+namespace { template <Ordinal_t N> struct CaseCollector; }
+
+// Static storage for the group fixture, nothing for the group without fixture
+template <typename FixtureT>
+struct GroupFixtureStorage
+{
+   alignas(FixtureT) unsigned char Storage[sizeof(FixtureT)];
+
+   static void* Create(void* storage) { return new (storage) FixtureT(); }
+   static void Destroy(void* fixture) { static_cast<FixtureT*>(fixture)->~FixtureT(); }
+
+   void Attach(GroupListEntry& group)
+   {
+      group.FixtureStorage = Storage;
+      group.FixtureCreate = Create;
+      group.FixtureDestroy = Destroy;
+      group.FixtureTypeId = &IRuntime::TypeId<FixtureT>::Id;
+   }
+};
+
+template <>
+struct GroupFixtureStorage<void>
+{
+   void Attach(GroupListEntry&) {}
+};
+
+// API to define the test group. The optional FixtureT is the group fixture: default 
+// constructible state shared by all cases of the group and available as 
+// runtime->Fixture<FixtureT>(), e.g. loaded dataset or started engine:
+//
+//    static tested::Group<CASE_COUNTER, Dataset> x("parser", __FILE__);
+//
+template <Ordinal_t N, typename FixtureT = void>
 struct Group final: private GroupListEntry
 {
 public:
@@ -851,6 +2170,8 @@ public:
       Storage& storage = Storage::Instance())
       : GroupListEntry(groupName, fileName)
    {
+      m_fixtureStorage.Attach(*this);
+
       try
       {
 
@@ -868,6 +2189,131 @@ public:
          storage.AddCollectionError(ex);
       }
    }
+
+private:
+   GroupFixtureStorage<FixtureT> m_fixtureStorage;
+};
+
+// Receives the cases made by the generator of GeneratedGroup
+struct CaseSink
+{
+   // Copies the name and the data into the arena, returns false when the arena is full
+   virtual bool Add(std::string_view name, std::string_view data = std::string_view()) = 0;
+};
+
+// The group with the cases made at runtime, e.g. one case for each input/expected-output pair
+// in the data directory. The generator is invoked on the first run or export of the group, so
+// a filtered out group does not walk the directory. All generated cases share one body:
+//
+//    static void CheckPair(tested::IRuntime* runtime)
+//    {
+//       runtime->StartCase(runtime->Generated().Name);
+//       const char* inputPath = runtime->Generated().Data;
+//       ...
+//    }
+//
+//    static tested::GeneratedGroup<4096, 256 * 1024> x("codec.files", __FILE__, 
+//       [](tested::CaseSink& sink) { ... sink.Add(name, path); }, CheckPair);
+//
+// The cases and their strings are kept in the static arena of MaxCasesP entries and MaxBytesP
+// bytes. The cases which do not fit are reported by the failed case 'arena overflow'.
+template <size_t MaxCasesP, size_t MaxBytesP>
+struct GeneratedGroup final: private GroupListEntry, private CaseSink
+{
+public:
+   typedef void (*Generator_t)(CaseSink& sink);
+
+   GeneratedGroup(const char* groupName, 
+      const char* fileName, 
+      Generator_t generator, 
+      CaseProc_t caseProc,
+      Storage& storage = Storage::Instance())
+      : GroupListEntry(groupName, fileName), m_generator(generator), m_caseProc(caseProc),
+        m_caseCount(0), m_bytesUsed(0), m_overflow(false)
+   {
+      GenerateCases = Generate;
+
+      CollectFailedException error(0, "Group must not have ':' in the name.");
+      error.GroupName = groupName;
+      error.FileName = fileName;
+      if (strchr(groupName, ':') != nullptr)
+         storage.AddCollectionError(error);
+      else
+         storage.AddGroup(this);
+   }
+
+private:
+   static_assert(MaxCasesP > 1, "Generated group needs the room for the cases");
+
+   static void Generate(GroupListEntry* group)
+   {
+      GeneratedGroup* self = static_cast<GeneratedGroup*>(group);
+      self->m_generator(*self);
+
+      // Last entry is reserved to report the overflow
+      if (self->m_overflow)
+      {
+         static const GeneratedCase overflow = { "arena overflow", nullptr };
+         self->Append(&overflow, ArenaOverflowCase);
+      }
+   }
+
+   static void ArenaOverflowCase(IRuntime* runtime)
+   {
+      runtime->StartCase("arena overflow");
+      Fail("Generated cases do not fit the arena of the group, increase its size");
+   }
+
+   bool Add(std::string_view name, std::string_view data) override
+   {
+      const size_t bytes = name.size() + data.size() + 2;
+      if (m_caseCount + 1 >= MaxCasesP || m_bytesUsed + bytes > MaxBytesP)
+      {
+         m_overflow = true;
+         return false;
+      }
+
+      GeneratedCase& generated = m_cases[m_caseCount];
+      generated.Name = Copy(name);
+      generated.Data = Copy(data);
+      Append(&generated, m_caseProc);
+      return true;
+   }
+
+   const char* Copy(std::string_view text)
+   {
+      char* copy = m_bytes + m_bytesUsed;
+      std::copy_n(text.data(), text.size(), copy);
+      copy[text.size()] = 0;
+      m_bytesUsed += text.size() + 1;
+      return copy;
+   }
+
+   // Cases run in the order of generation and are numbered in it, the numbers past the range of
+   // Ordinal_t stay at its maximum
+   void Append(const GeneratedCase* generated, CaseProc_t caseProc)
+   {
+      const size_t ordinal = m_caseCount;
+      CaseListEntry& entry = m_entries[m_caseCount++];
+      entry.Next = nullptr;
+      entry.CaseProc = caseProc;
+      entry.Ordinal = static_cast<Ordinal_t>(ordinal < SCHAR_MAX ? ordinal : SCHAR_MAX);
+      entry.Generated = generated;
+
+      if (m_caseCount == 1)
+         CaseListHead = &entry;
+      else
+         m_entries[m_caseCount - 2].Next = &entry;
+   }
+
+   Generator_t   m_generator;
+   CaseProc_t    m_caseProc;
+   size_t        m_caseCount;
+   size_t        m_bytesUsed;
+   bool          m_overflow;
+   CaseListEntry m_entries[MaxCasesP];
+   GeneratedCase m_cases[MaxCasesP];
+   char          m_bytes[MaxBytesP];
 };
 
 
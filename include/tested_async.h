@@ -0,0 +1,962 @@
+//
+//   \|/ Tested
+//   /|\ Async cases and virtual time
+//
+//  The backend which runs the async cases (IRuntime::StartAsyncCase()) on the single thread of
+//  EventLoop and lets the code under test wait for the timeouts by the virtual tested::Clock.
+//  The test executable defines one AsyncRunner in the translation unit with main(), its template
+//  arguments size the slots of the cases in flight and the tables of the loop:
+//
+//     static tested::AsyncRunner<256> s_asyncRunner;
+//
+//  Without it the async cases fail, the clock does not jump and the real sleeps of the cases 
+//  are not reported.
+//
+#pragma once
+
+#include "tested.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#define TESTED_EPOLL_SUPPORTED 1
+#define TESTED_SLEEP_METER_SUPPORTED 1
+#endif
+
+namespace tested {
+
+// Virtual time for the code under test which sleeps or waits for the timeouts. The code is built
+// against tested::Clock instead of std::chrono::steady_clock and sleeps by Clock::SleepFor(). 
+// The clock goes with the steady clock, but when all participant threads sleep on it, it jumps 
+// to the nearest deadline instead of waiting, so the ten seconds timeout passes at once. The 
+// thread which runs the cases is the participant, other threads which sleep on the clock hold
+// Clock::Participant, otherwise the clock does not wait for them and may jump while they work.
+// The clock does not jump past the timers of EventLoop and while it waits for the descriptors, 
+// that is the real I/O.
+class Clock
+{
+public:
+   typedef std::chrono::steady_clock::duration duration;
+   typedef duration::rep                       rep;
+   typedef duration::period                    period;
+   typedef std::chrono::time_point<Clock>      time_point;
+   static constexpr bool is_steady = true;
+
+   enum 
+   { 
+      kMaxSleepers = 64,
+      kMaxParticipants = 64
+   };
+
+   static time_point now() noexcept
+   {
+      return time_point(std::chrono::steady_clock::now().time_since_epoch() + 
+         duration(State().Offset.load(std::memory_order_acquire)));
+   }
+
+   template <typename RepT, typename PeriodT>
+   static void SleepFor(std::chrono::duration<RepT, PeriodT> delay)
+   {
+      SleepUntil(now() + std::chrono::duration_cast<duration>(delay));
+   }
+
+   // The sleeper waits for the free entry when all of them are taken, the clock does not jump 
+   // past the deadline it has not recorded
+   static void SleepUntil(time_point deadline)
+   {
+      ClockState& state = State();
+      std::unique_lock<std::mutex> lock(state.Lock);
+
+      int slot = FindSleeper(state, std::thread::id());
+      while (slot < 0)
+      {
+         state.WaitingForSleeper += 1;
+         state.Changed.wait(lock);
+         state.WaitingForSleeper -= 1;
+         slot = FindSleeper(state, std::thread::id());
+      }
+      state.Sleepers[slot].Thread = std::this_thread::get_id();
+      state.Sleepers[slot].Deadline = deadline;
+
+      while (now() < deadline)
+      {
+         if (state.Virtual && state.Participants > 0 && ParticipantsSleep(state) &&
+            JumpToNearest(state))
+            continue;
+
+         const duration offset(state.Offset.load(std::memory_order_acquire));
+         state.Changed.wait_until(lock, 
+            std::chrono::steady_clock::time_point(deadline.time_since_epoch() - offset));
+      }
+      state.Sleepers[slot].Thread = std::thread::id();
+      if (state.WaitingForSleeper > 0)
+         state.Changed.notify_all();
+   }
+
+   // One more thread takes part in the virtual time: the clock does not jump while it runs.
+   // Create it before the thread starts and pass it to the thread function by value, the thread
+   // which receives it is the participant:
+   //
+   //    std::thread worker([](tested::Clock::Participant) { ... }, tested::Clock::Participant());
+   //
+   class Participant
+   {
+   public:
+      Participant() : m_slot(-1)
+      {
+         ClockState& state = State();
+         std::lock_guard<std::mutex> lock(state.Lock);
+         for (int i = 0; i < kMaxParticipants && m_slot < 0; ++i)
+         {
+            if (state.Holders[i] == std::thread::id())
+               m_slot = i;
+         }
+         if (m_slot < 0)
+            Fail("Too many participants of tested::Clock");
+
+         state.Holders[m_slot] = std::this_thread::get_id();
+         state.Participants += 1;
+      }
+
+      // The thread which moves it in holds it now
+      Participant(Participant&& other) noexcept : m_slot(other.m_slot)
+      {
+         other.m_slot = -1;
+         if (m_slot < 0)
+            return;
+
+         ClockState& state = State();
+         std::lock_guard<std::mutex> lock(state.Lock);
+         state.Holders[m_slot] = std::this_thread::get_id();
+         state.Changed.notify_all();
+      }
+
+      ~Participant()
+      {
+         if (m_slot < 0)
+            return;
+
+         ClockState& state = State();
+         std::lock_guard<std::mutex> lock(state.Lock);
+         state.Holders[m_slot] = std::thread::id();
+         state.Participants -= 1;
+         state.Changed.notify_all();
+      }
+
+      Participant(const Participant&) = delete;
+      Participant& operator=(const Participant&) = delete;
+      Participant& operator=(Participant&&) = delete;
+
+   private:
+      int m_slot;
+   };
+
+   // The calling thread holds a participant
+   static bool IsParticipant()
+   {
+      ClockState& state = State();
+      const std::thread::id thread = std::this_thread::get_id();
+      std::lock_guard<std::mutex> lock(state.Lock);
+      return std::find(state.Holders, state.Holders + kMaxParticipants, thread) != 
+         state.Holders + kMaxParticipants;
+   }
+
+   // The clock does not jump past the horizon, EventLoop keeps it at its nearest timer or at
+   // time_point::min() while it watches the descriptors
+   static void SetHorizon(time_point horizon)
+   {
+      ClockState& state = State();
+      const rep previous = state.Horizon.exchange(horizon.time_since_epoch().count(),
+         std::memory_order_acq_rel);
+      if (previous < horizon.time_since_epoch().count())
+      {
+         std::lock_guard<std::mutex> lock(state.Lock);
+         state.Changed.notify_all();
+      }
+   }
+
+   static void LowerHorizon(time_point horizon)
+   {
+      const rep value = horizon.time_since_epoch().count();
+      std::atomic<rep>& current = State().Horizon;
+      rep previous = current.load(std::memory_order_acquire);
+      while (value < previous && 
+         !current.compare_exchange_weak(previous, value, std::memory_order_acq_rel))
+      {}
+   }
+
+   // The clock is virtual by default, the real one never jumps
+   static void SetVirtual(bool isVirtual)
+   {
+      std::lock_guard<std::mutex> lock(State().Lock);
+      State().Virtual = isVirtual;
+   }
+
+   static bool IsVirtual()
+   {
+      std::lock_guard<std::mutex> lock(State().Lock);
+      return State().Virtual;
+   }
+
+   // How far the clock is ahead of the steady clock
+   static duration Skipped() { return duration(State().Offset.load(std::memory_order_acquire)); }
+
+private:
+   struct Sleeper
+   {
+      std::thread::id Thread; // none for the free entry
+      time_point      Deadline;
+   };
+
+   struct ClockState
+   {
+      std::mutex              Lock;
+      std::condition_variable Changed;
+      std::atomic<rep>        Offset;
+      std::atomic<rep>        Horizon;
+      bool                    Virtual;
+      int                     Participants;
+      int                     WaitingForSleeper;
+      std::thread::id         Holders[kMaxParticipants]; // threads of the participants
+      Sleeper                 Sleepers[kMaxSleepers];
+   };
+
+   static ClockState& State()
+   {
+      static ClockState s_state{ {}, {}, {0}, {time_point::max().time_since_epoch().count()}, 
+         true, 0, 0, {}, {} };
+      return s_state;
+   }
+
+   static int FindSleeper(const ClockState& state, std::thread::id thread)
+   {
+      for (int i = 0; i < kMaxSleepers; ++i)
+      {
+         if (state.Sleepers[i].Thread == thread)
+            return i;
+      }
+      return -1;
+   }
+
+   // The threads which do not take part sleep or work as they like. The sleeping thread stands 
+   // for one participant, the one it holds for the thread which has not started yet is awake.
+   // The caller holds the lock.
+   static bool ParticipantsSleep(const ClockState& state)
+   {
+      for (int i = 0; i < kMaxParticipants; ++i)
+      {
+         const std::thread::id holder = state.Holders[i];
+         if (holder == std::thread::id())
+            continue;
+         if (FindSleeper(state, holder) < 0 || 
+            std::find(state.Holders, state.Holders + i, holder) != state.Holders + i)
+            return false;
+      }
+      return true;
+   }
+
+   // Everyone sleeps, the nearest sleeper wakes up now unless the horizon is nearer. The caller
+   // holds the lock. Returns false if the clock cannot move.
+   static bool JumpToNearest(ClockState& state)
+   {
+      time_point nearest(duration(state.Horizon.load(std::memory_order_acquire)));
+      for (const Sleeper& sleeper : state.Sleepers)
+      {
+         if (sleeper.Thread != std::thread::id() && sleeper.Deadline < nearest)
+            nearest = sleeper.Deadline;
+      }
+      const time_point current = now();
+      if (nearest == time_point::max() || nearest <= current)
+         return false;
+
+      state.Offset.fetch_add((nearest - current).count(), std::memory_order_acq_rel);
+      state.Changed.notify_all();
+      return true;
+   }
+};
+
+// Real time spent in nanosleep(), usleep(), sleep() and clock_nanosleep(), the runner reports 
+// it for each case, see IRunObserver::OnCaseSlept(). Each thread counts its own sleeps, the case
+// is charged with the sleeps of the thread which runs it and of the threads which hold 
+// Clock::Participant, the other threads of the process do not count. The sleeps are counted when
+// one translation unit of the test executable includes tested_sleep_meter.h.
+struct SleepMeter
+{
+   // Sleeps of the calling thread
+   static long long ThreadNanoseconds() { return Current().Slept; }
+
+   // Sleeps charged to the cases, called by the thread which runs them
+   static long long CaseNanoseconds() 
+   { 
+      return Current().Slept + Helpers().load(std::memory_order_relaxed); 
+   }
+
+   // The calling thread runs the cases (see AsyncRunner), the others which hold the participant 
+   // are the helpers of the cases
+   static void SetRunsCases(bool runsCases) { Current().RunsCases = runsCases; }
+
+#if defined(TESTED_SLEEP_METER_SUPPORTED)
+   // clock_nanosleep() through the system call, it returns -1 and sets errno on error
+   static int Sleep(clockid_t clock, int flags, const timespec* request, timespec* remain)
+   {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      const long result = syscall(SYS_clock_nanosleep, clock, flags, request, remain);
+      const long long slept = std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now() - start).count();
+      PerThread& current = Current();
+      current.Slept += slept;
+      if (!current.RunsCases && Clock::IsParticipant())
+         Helpers().fetch_add(slept, std::memory_order_relaxed);
+      return static_cast<int>(result);
+   }
+#endif
+
+   // Sleep of the library itself, e.g. the driver of the benchmark, it is not counted
+   template <typename RepT, typename PeriodT>
+   static void SleepUncounted(std::chrono::duration<RepT, PeriodT> delay)
+   {
+#if defined(TESTED_SLEEP_METER_SUPPORTED)
+      const long long nanoseconds = 
+         std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count();
+      if (nanoseconds <= 0)
+         return;
+
+      timespec request = { static_cast<time_t>(nanoseconds / 1000000000), 
+         static_cast<long>(nanoseconds % 1000000000) };
+      while (syscall(SYS_clock_nanosleep, CLOCK_MONOTONIC, 0, &request, &request) != 0 && 
+         errno == EINTR)
+         ;
+#else
+      std::this_thread::sleep_for(delay);
+#endif
+   }
+
+private:
+   struct PerThread
+   {
+      long long Slept;
+      bool      RunsCases;
+   };
+
+   static PerThread& Current()
+   {
+      thread_local PerThread t_current = { 0, false };
+      return t_current;
+   }
+
+   static std::atomic<long long>& Helpers()
+   {
+      static std::atomic<long long> s_helpers(0);
+      return s_helpers;
+   }
+};
+// Callable stored in place without dynamic memory, see EventLoop. It is invoked with the ready
+// events of the descriptor or with 0 by the timers, the callable takes them or no arguments.
+class Callback
+{
+public:
+   enum { kMaxSize = 64 };
+
+   Callback() : m_invoke(nullptr), m_manage(nullptr) {}
+
+   template <typename FunctionT, 
+      typename = std::enable_if_t<!std::is_same_v<std::decay_t<FunctionT>, Callback>>>
+   Callback(FunctionT&& function)
+   {
+      typedef std::decay_t<FunctionT> Function;
+      static_assert(sizeof(Function) <= kMaxSize, 
+         "Callback captures too much, capture the pointer to the state instead");
+      static_assert(alignof(Function) <= alignof(std::max_align_t), "Callback is overaligned");
+
+      new (m_storage) Function(std::forward<FunctionT>(function));
+      m_invoke = [](void* storage, unsigned events)
+      {
+         Function& invocable = *static_cast<Function*>(storage);
+         if constexpr (std::is_invocable_v<Function&, unsigned>)
+            invocable(events);
+         else
+            invocable();
+      };
+      // Moves the callable to the target and destroys the source, or just destroys it
+      m_manage = [](void* target, void* source)
+      {
+         if (target != nullptr)
+            new (target) Function(std::move(*static_cast<Function*>(source)));
+         static_cast<Function*>(source)->~Function();
+      };
+   }
+
+   Callback(Callback&& other) : m_invoke(other.m_invoke), m_manage(other.m_manage)
+   {
+      if (m_manage != nullptr)
+         m_manage(m_storage, other.m_storage);
+      other.m_invoke = nullptr;
+      other.m_manage = nullptr;
+   }
+
+   Callback& operator=(Callback&& other)
+   {
+      if (this != &other)
+      {
+         Reset();
+         new (this) Callback(std::move(other));
+      }
+      return *this;
+   }
+
+   Callback(const Callback&) = delete;
+   Callback& operator=(const Callback&) = delete;
+
+   ~Callback() { Reset(); }
+
+   void Reset()
+   {
+      if (m_manage != nullptr)
+         m_manage(nullptr, m_storage);
+      m_invoke = nullptr;
+      m_manage = nullptr;
+   }
+
+   explicit operator bool() const { return m_invoke != nullptr; }
+   void operator()(unsigned events) { m_invoke(m_storage, events); }
+
+private:
+   alignas(std::max_align_t) unsigned char m_storage[kMaxSize];
+   void (*m_invoke)(void* storage, unsigned events);
+   void (*m_manage)(void* target, void* source);
+};
+// Single-threaded loop of async cases: one-shot watches of file descriptors (epoll) and timers.
+// Each watch or timer belongs to the async case which was running when it was registered. The 
+// timers go by tested::Clock, so the loop which waits only for the timers skips the wait. The 
+// tables are kept by AsyncRunner.
+class EventLoop
+{
+public:
+   enum { kMaxReadyEvents = 64 };
+
+   typedef int TimerId_t;
+   typedef Clock Clock_t;
+
+   struct WatchEntry
+   {
+      bool     Active;
+      int      Fd;
+      unsigned Owner;
+      Callback Function;
+   };
+
+   struct TimerEntry
+   {
+      TimerId_t          Id; // 0 for the free entry
+      unsigned           Owner;
+      Clock_t::time_point Deadline;
+      Callback           Function;
+   };
+
+   struct FinalizerEntry
+   {
+      unsigned Owner; // 0 for the free entry
+      Callback Function;
+   };
+
+   // Expired timer in RunOnce(), there are as many of them as the timers
+   struct DueTimer
+   {
+      Clock_t::time_point Deadline;
+      TimerId_t           Id;
+      int                 Index;
+   };
+
+   static EventLoop& Instance()
+   {
+      static EventLoop s_loop;
+      return s_loop;
+   }
+
+   // Calls the callback once when the descriptor is ready for the events (EPOLLIN, EPOLLOUT) or
+   // has an error, the callback receives the ready events
+   void Watch(int fd, unsigned events, Callback callback)
+   {
+#if defined(TESTED_EPOLL_SUPPORTED)
+      int free = -1;
+      for (int i = 0; i < m_maxWatches; ++i)
+      {
+         if (m_watches[i].Active && m_watches[i].Fd == fd)
+            Fail("The descriptor is already watched");
+         if (!m_watches[i].Active && free < 0)
+            free = i;
+      }
+      if (free < 0)
+         Fail(m_maxWatches == 0 ? kNoTables : "Too many watched descriptors");
+
+      epoll_event event;
+      event.events = events | EPOLLONESHOT;
+      event.data.u32 = static_cast<uint32_t>(free);
+      if (epoll_ctl(Poller(), EPOLL_CTL_ADD, fd, &event) != 0)
+         Fail("Failed to watch the descriptor");
+
+      WatchEntry& watch = m_watches[free];
+      watch.Active = true;
+      watch.Fd = fd;
+      watch.Owner = m_currentOwner;
+      watch.Function = std::move(callback);
+      m_watchCount += 1;
+      Clock_t::LowerHorizon(Clock_t::time_point::min());
+#else
+      (void)fd;
+      (void)events;
+      (void)callback;
+      Fail("Watching descriptors is not supported on this platform");
+#endif
+   }
+
+   void Unwatch(int fd)
+   {
+      for (int i = 0; i < m_maxWatches; ++i)
+      {
+         if (m_watches[i].Active && m_watches[i].Fd == fd)
+            RemoveWatch(m_watches[i]);
+      }
+      UpdateHorizon();
+   }
+
+   // Calls the callback after the delay
+   TimerId_t After(int milliseconds, Callback callback)
+   {
+      for (int i = 0; i < m_maxTimers; ++i)
+      {
+         TimerEntry& timer = m_timers[(m_timerHint + i) % m_maxTimers];
+         if (timer.Id != 0)
+            continue;
+
+         m_timerHint = (m_timerHint + i + 1) % m_maxTimers;
+         m_lastTimerId = m_lastTimerId == INT32_MAX ? 1 : m_lastTimerId + 1;
+         timer.Id = m_lastTimerId;
+         timer.Owner = m_currentOwner;
+         timer.Deadline = Clock_t::now() + std::chrono::milliseconds(milliseconds);
+         timer.Function = std::move(callback);
+         m_timerCount += 1;
+         Clock_t::LowerHorizon(timer.Deadline);
+         return timer.Id;
+      }
+      Fail(m_maxTimers == 0 ? kNoTables : "Too many timers");
+      return 0;
+   }
+
+   // Calls the callback on the next iteration of the loop
+   void Post(Callback callback) { After(0, std::move(callback)); }
+
+   void Cancel(TimerId_t id)
+   {
+      for (int i = 0; i < m_maxTimers && id != 0; ++i)
+      {
+         if (m_timers[i].Id == id)
+            RemoveTimer(m_timers[i]);
+      }
+      UpdateHorizon();
+   }
+
+   // Calls the callback when the async case which owns it is over: complete, timed out or 
+   // dropped. It frees what the pending callbacks of the case refer to.
+   void AtOwnerDone(Callback callback)
+   {
+      if (m_currentOwner == 0)
+         Fail("Only async case can register the callback for its end");
+
+      for (int i = 0; i < m_maxFinalizers; ++i)
+      {
+         FinalizerEntry& finalizer = m_finalizers[i];
+         if (finalizer.Owner != 0)
+            continue;
+
+         finalizer.Owner = m_currentOwner;
+         finalizer.Function = std::move(callback);
+         m_finalizerCount += 1;
+         return;
+      }
+      Fail(m_maxFinalizers == 0 ? kNoTables : "Too many callbacks for the end of async cases");
+   }
+
+   // Drops the watches and timers of the async case, then calls its AtOwnerDone() callbacks
+   void CancelOwner(unsigned owner)
+   {
+      for (int i = 0; i < m_maxWatches && m_watchCount > 0; ++i)
+      {
+         if (m_watches[i].Active && m_watches[i].Owner == owner)
+            RemoveWatch(m_watches[i]);
+      }
+      for (int i = 0; i < m_maxTimers && m_timerCount > 0; ++i)
+      {
+         if (m_timers[i].Id != 0 && m_timers[i].Owner == owner)
+            RemoveTimer(m_timers[i]);
+      }
+      UpdateHorizon();
+      for (int i = 0; i < m_maxFinalizers && m_finalizerCount > 0; ++i)
+      {
+         FinalizerEntry& finalizer = m_finalizers[i];
+         if (finalizer.Owner != owner)
+            continue;
+
+         Callback function(std::move(finalizer.Function));
+         finalizer.Owner = 0;
+         finalizer.Function.Reset();
+         m_finalizerCount -= 1;
+
+         // The case has its result already, so the failure has nowhere to go
+         const unsigned previous = m_currentOwner;
+         m_currentOwner = 0;
+         try
+         {
+            function(0);
+         }
+         catch (...)
+         {
+         }
+         m_currentOwner = previous;
+      }
+   }
+
+   bool Empty() const { return m_watchCount == 0 && m_timerCount == 0; }
+
+   // Real sleeps of the running callback since the previous call, 0 outside of the callbacks
+   long long TakeSlept()
+   {
+      if (!m_dispatching)
+         return 0;
+      const long long since = m_sleptSince;
+      m_sleptSince = SleepMeter::CaseNanoseconds();
+      return m_sleptSince - since;
+   }
+
+   // The async case which owns the callbacks registered now, set by the runtime
+   unsigned CurrentOwner() const { return m_currentOwner; }
+   void SetCurrentOwner(unsigned owner) { m_currentOwner = owner; }
+
+   IAsyncOwners* Owners() const { return m_owners; }
+
+   IAsyncOwners* SetOwners(IAsyncOwners* owners)
+   {
+      IAsyncOwners* previous = m_owners;
+      m_owners = owners;
+      return previous;
+   }
+
+   // Waits up to timeoutMs (-1 is until the next timer) for the ready descriptors and invokes 
+   // the callbacks of them and of the expired timers
+   void RunOnce(int timeoutMs = -1)
+   {
+      int wait = timeoutMs;
+      const Clock_t::time_point next = UpdateHorizon();
+      if (m_timerCount > 0)
+      {
+         const auto untilNext = std::chrono::duration_cast<std::chrono::milliseconds>(
+            next - Clock_t::now() + std::chrono::microseconds(999)).count();
+         const int untilNextMs = static_cast<int>((std::max)(0LL, 
+            static_cast<long long>(untilNext)));
+         wait = wait < 0 ? untilNextMs : (std::min)(wait, untilNextMs);
+      }
+      if (wait < 0 && m_watchCount == 0)
+         return;
+
+      // Nothing but the timers, the virtual clock jumps to the nearest one
+      if (m_watchCount == 0)
+      {
+         if (wait > 0)
+         {
+            const Clock_t::time_point until = Clock_t::now() + std::chrono::milliseconds(wait);
+            Clock_t::SleepUntil(next < until ? next : until);
+         }
+         wait = 0;
+      }
+
+#if defined(TESTED_EPOLL_SUPPORTED)
+      epoll_event events[kMaxReadyEvents];
+      const int ready = epoll_wait(Poller(), events, kMaxReadyEvents, wait);
+      for (int i = 0; i < ready; ++i)
+      {
+         WatchEntry& watch = m_watches[events[i].data.u32];
+         if (!watch.Active)
+            continue;
+
+         const unsigned owner = watch.Owner;
+         Callback function(std::move(watch.Function));
+         RemoveWatch(watch);
+         Dispatch(owner, function, events[i].events);
+      }
+#endif
+
+      // The expired timers fire by their deadlines, the ones with the same deadline in the order
+      // they were set. The timers set by the callbacks wait for the next time.
+      const Clock_t::time_point now = Clock_t::now();
+      int dueCount = 0;
+      for (int i = 0; i < m_maxTimers && m_timerCount > 0; ++i)
+      {
+         const TimerEntry& timer = m_timers[i];
+         if (timer.Id != 0 && timer.Deadline <= now)
+            m_due[dueCount++] = DueTimer{ timer.Deadline, timer.Id, i };
+      }
+      std::sort(m_due, m_due + dueCount, [](const DueTimer& left, const DueTimer& right)
+      {
+         return left.Deadline != right.Deadline ? left.Deadline < right.Deadline : 
+            left.Id < right.Id;
+      });
+
+      for (int i = 0; i < dueCount; ++i)
+      {
+         // The callback before it may cancel the timer
+         TimerEntry& timer = m_timers[m_due[i].Index];
+         if (timer.Id != m_due[i].Id)
+            continue;
+
+         const unsigned owner = timer.Owner;
+         Callback function(std::move(timer.Function));
+         RemoveTimer(timer);
+         Dispatch(owner, function, 0);
+      }
+      UpdateHorizon();
+   }
+
+   // The tables of the loop, the free entries are zeroed
+   void SetTables(WatchEntry* watches, int maxWatches, TimerEntry* timers, DueTimer* due, 
+      int maxTimers, FinalizerEntry* finalizers, int maxFinalizers)
+   {
+      m_watches = watches;
+      m_maxWatches = maxWatches;
+      m_timers = timers;
+      m_due = due;
+      m_maxTimers = maxTimers;
+      m_finalizers = finalizers;
+      m_maxFinalizers = maxFinalizers;
+   }
+
+private:
+   static constexpr const char* kNoTables = "The event loop has no tables, see AsyncRunner";
+
+   EventLoop()
+      : m_owners(nullptr), m_currentOwner(0), m_watchCount(0), m_timerCount(0), m_timerHint(0),
+        m_lastTimerId(0), m_finalizerCount(0), m_dispatching(false), m_sleptSince(0),
+        m_poller(-1), m_pollerPid(0), m_watches(nullptr), m_maxWatches(0), m_timers(nullptr),
+        m_due(nullptr), m_maxTimers(0), m_finalizers(nullptr), m_maxFinalizers(0)
+   {}
+
+#if defined(TESTED_EPOLL_SUPPORTED)
+   // The forked worker gets its own epoll instance, the inherited one is shared with the parent
+   int Poller()
+   {
+      const int pid = static_cast<int>(getpid());
+      if (m_poller < 0 || m_pollerPid != pid)
+      {
+         m_poller = epoll_create1(EPOLL_CLOEXEC);
+         m_pollerPid = pid;
+         if (m_poller < 0)
+            Fail("Failed to create epoll instance");
+      }
+      return m_poller;
+   }
+#endif
+
+   // The virtual clock does not jump past the nearest timer or while the descriptors are
+   // watched, returns the nearest timer
+   Clock_t::time_point UpdateHorizon() const
+   {
+      Clock_t::time_point next = Clock_t::time_point::max();
+      for (int i = 0; i < m_maxTimers && m_timerCount > 0; ++i)
+      {
+         if (m_timers[i].Id != 0 && m_timers[i].Deadline < next)
+            next = m_timers[i].Deadline;
+      }
+      Clock_t::SetHorizon(m_watchCount > 0 ? Clock_t::time_point::min() : next);
+      return next;
+   }
+
+   void RemoveWatch(WatchEntry& watch)
+   {
+#if defined(TESTED_EPOLL_SUPPORTED)
+      epoll_ctl(Poller(), EPOLL_CTL_DEL, watch.Fd, nullptr);
+#endif
+      watch.Active = false;
+      watch.Function.Reset();
+      m_watchCount -= 1;
+   }
+
+   void RemoveTimer(TimerEntry& timer)
+   {
+      timer.Id = 0;
+      timer.Function.Reset();
+      m_timerCount -= 1;
+   }
+
+   // Exception from the callback is the result of the case which owns it
+   void Dispatch(unsigned owner, Callback& function, unsigned events)
+   {
+      const unsigned previous = m_currentOwner;
+      m_currentOwner = owner;
+      m_dispatching = true;
+      m_sleptSince = SleepMeter::CaseNanoseconds();
+      try
+      {
+         function(events);
+         const long long slept = TakeSlept();
+         if (slept > 0 && owner != 0 && m_owners != nullptr)
+            m_owners->AddSleep(owner, slept);
+      }
+      catch (const CaseFailed& ex)
+      {
+         CompleteOwner(owner, CaseResult_Failed, ex.Message.CData());
+      }
+      catch (CaseSkipped)
+      {
+         CompleteOwner(owner, CaseResult_Skipped, std::string_view());
+      }
+      catch (const ProcessCorruptedException&)
+      {
+         m_currentOwner = previous;
+         m_dispatching = false;
+         throw;
+      }
+      catch (const std::exception& ex)
+      {
+         CompleteOwner(owner, CaseResult_Failed, ex.what());
+      }
+      catch (...)
+      {
+         CompleteOwner(owner, CaseResult_Failed, "Unknown exception");
+      }
+      m_currentOwner = previous;
+      m_dispatching = false;
+   }
+
+   void CompleteOwner(unsigned owner, CaseResult_t code, std::string_view message)
+   {
+      if (owner != 0 && m_owners != nullptr)
+         m_owners->Complete(owner, code, message);
+      else if (code == CaseResult_Failed)
+         printf("Callback of no case failed: %.*s\n", static_cast<int>(message.size()), 
+            message.data());
+   }
+
+   IAsyncOwners* m_owners;
+   unsigned      m_currentOwner;
+   int           m_watchCount;
+   int           m_timerCount;
+   int           m_timerHint;
+   TimerId_t     m_lastTimerId;
+   int           m_finalizerCount;
+   bool          m_dispatching;
+   long long     m_sleptSince;
+   int           m_poller;
+   int           m_pollerPid;
+   WatchEntry*   m_watches;
+   int           m_maxWatches;
+   TimerEntry*   m_timers;
+   DueTimer*     m_due;
+   int           m_maxTimers;
+   FinalizerEntry* m_finalizers;
+   int           m_maxFinalizers;
+};
+// The event loop and the slots of the async cases in flight for the runtime, see the top of the 
+// file. MaxCasesP is how many async cases are in flight at most (Subset::LimitAsync() lowers 
+// it), the rest are the sizes of the tables of EventLoop. The thread which runs the cases is the
+// participant of tested::Clock while the run goes.
+template <int MaxCasesP = 256, int MaxWatchesP = 256, int MaxTimersP = 1024, 
+   int MaxFinalizersP = MaxCasesP>
+class AsyncRunner final : public Subset::IAsyncBackend
+{
+public:
+   // The owner of the async case keeps the slot in 13 bits
+   static_assert(MaxCasesP > 0 && MaxCasesP < 8192, "Too many async cases");
+
+   AsyncRunner() : m_cases(), m_watches(), m_timers(), m_due(), m_finalizers(), m_runs(0)
+   {
+      EventLoop::Instance().SetTables(m_watches, MaxWatchesP, m_timers, m_due, MaxTimersP, 
+         m_finalizers, MaxFinalizersP);
+      Installed() = this;
+   }
+
+   ~AsyncRunner()
+   {
+      if (Installed() == this)
+         Installed() = nullptr;
+      EventLoop::Instance().SetTables(nullptr, 0, nullptr, nullptr, 0, nullptr, 0);
+   }
+
+   AsyncRunner(const AsyncRunner&) = delete;
+   AsyncRunner& operator=(const AsyncRunner&) = delete;
+
+   IAsyncOwners* Attach(IAsyncOwners* owners) final
+   {
+      // The nested run on the same thread does not count twice
+      if (m_runs++ == 0)
+      {
+         m_participant.emplace();
+         SleepMeter::SetRunsCases(true);
+      }
+      return EventLoop::Instance().SetOwners(owners);
+   }
+
+   void Detach(IAsyncOwners* previous) final
+   {
+      EventLoop::Instance().SetOwners(previous);
+      if (--m_runs == 0)
+      {
+         SleepMeter::SetRunsCases(false);
+         m_participant.reset();
+      }
+   }
+
+   Subset::AsyncCase* Cases() final { return m_cases; }
+   unsigned MaxCases() const final { return MaxCasesP; }
+
+   void SetCurrentOwner(unsigned owner) final { EventLoop::Instance().SetCurrentOwner(owner); }
+
+   // The timer belongs to the current owner, so its failure is the result of the case
+   void SetTimeout(int timeoutMs) final
+   {
+      EventLoop::Instance().After(timeoutMs, [timeoutMs]
+      {
+         char message[64];
+         snprintf(message, sizeof(message), "Async case is not complete in %d ms", timeoutMs);
+         Fail(message);
+      });
+   }
+
+   void CancelOwner(unsigned owner) final { EventLoop::Instance().CancelOwner(owner); }
+
+   bool RunOnce() final
+   {
+      EventLoop& loop = EventLoop::Instance();
+      if (loop.Empty())
+         return false;
+      loop.RunOnce(-1);
+      return true;
+   }
+
+   long long SleptNs() const final { return SleepMeter::CaseNanoseconds(); }
+   long long TakeSlept() final { return EventLoop::Instance().TakeSlept(); }
+
+private:
+   Subset::AsyncCase         m_cases[MaxCasesP];
+   EventLoop::WatchEntry     m_watches[MaxWatchesP];
+   EventLoop::TimerEntry     m_timers[MaxTimersP];
+   EventLoop::DueTimer       m_due[MaxTimersP];
+   EventLoop::FinalizerEntry m_finalizers[MaxFinalizersP];
+   int                       m_runs;
+   std::optional<Clock::Participant> m_participant; // the clock jumps only when the cases sleep
+};
+
+} // namespace tested
@@ -0,0 +1,2849 @@
+//
+//   \|/ Tested
+//   /|\ Benchmarks
+//
+//  The benchmark backend for test cases registered with tested.h.
+//
+//  The core library deliberately does not measure performance, so this header adds it on top:
+//  a benchmark is an ordinary Case<N> that invokes bench::Run() after StartCase(). The runner
+//  wraps the run observer into bench::Session which knows the address of the running case
+//  ('group:case'), can save the results into a baseline file and compare the later runs against
+//  it. A significant regression fails the case, so it is reported as any other failure.
+//
+//     template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+//     {
+//        runtime->StartCase("push_back");
+//        tested::bench::Run(runtime, [](tested::bench::State& state)
+//        {
+//           for (auto _: state)
+//              ...
+//        });
+//     }
+//
+//  Samples are kept in fixed size arrays like in the rest of library, so there are no dynamic
+//  memory allocations made by the measurements.
+//
+#pragma once
+
+#include "tested.h"
+#include "tested_async.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <emmintrin.h>
+#define TESTED_BENCH_CLFLUSH 1
+#endif
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace tested {
+namespace bench {
+
+typedef int64_t Count_t;
+
+enum
+{
+   kMaxRepetitions = 64,  // max samples kept per benchmark
+   kMaxCounters    = 8,   // max user counters per benchmark
+   kMaxAddress     = 128, // 'group:case' address storage
+   kMaxSweepPoints = 64,  // max argument values in a parameter sweep
+   kMaxThreads     = 256  // max threads in scaling benchmark
+};
+
+// Prevents the compiler from optimizing away the value computed in benchmark loop
+template <typename T>
+inline void DoNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+   asm volatile("" : : "r,m"(value) : "memory");
+#else
+   const volatile char* sink = reinterpret_cast<const volatile char*>(&value);
+   (void)*sink;
+#endif
+}
+
+// Clocks used for measurements, both return nanoseconds
+struct Clock
+{
+   static double RealNs()
+   {
+      typedef std::chrono::steady_clock SteadyClock;
+      return std::chrono::duration<double, std::nano>(
+         SteadyClock::now().time_since_epoch()).count();
+   }
+
+   static double CpuNs()
+   {
+#if defined(_WIN32)
+      return static_cast<double>(clock()) * (1e9 / CLOCKS_PER_SEC);
+#else
+      timespec ts;
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+      return static_cast<double>(ts.tv_sec) * 1e9 + static_cast<double>(ts.tv_nsec);
+#endif
+   }
+};
+
+// Evicts the data from CPU caches to measure the cold cache case. Two methods are available:
+// touching the buffer bigger than the last level cache, or flushing the cache lines of the
+// working set explicitly (clflush, x86 only, the buffer method is used elsewhere).
+struct CacheEvictor
+{
+   enum { kLineSize = 64 };
+
+   // Size of the last level cache, 32MB if it can not be detected
+   static size_t LastLevelCacheSize()
+   {
+      static size_t s_size = DetectLastLevelCacheSize();
+      return s_size;
+   }
+
+   // Touches (writes) every cache line of buffer twice the size of LLC. The buffer is allocated
+   // once on the first use.
+   static void EvictByBuffer()
+   {
+      static const size_t s_size = 2 * LastLevelCacheSize();
+      static volatile char* s_buffer = static_cast<volatile char*>(calloc(s_size, 1));
+      if (s_buffer == nullptr)
+         return;
+
+      for (size_t i = 0; i < s_size; i += kLineSize)
+         s_buffer[i] = static_cast<char>(s_buffer[i] + 1);
+   }
+
+   static void Flush(const void* data, size_t size)
+   {
+#if defined(TESTED_BENCH_CLFLUSH)
+      const char* begin = static_cast<const char*>(data);
+      for (size_t i = 0; i < size; i += kLineSize)
+         _mm_clflush(begin + i);
+      if (size > 0)
+         _mm_clflush(begin + size - 1);
+      _mm_mfence();
+#else
+      (void)data;
+      (void)size;
+      EvictByBuffer();
+#endif
+   }
+
+private:
+   static size_t DetectLastLevelCacheSize()
+   {
+      long size = 0;
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+      size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+      if (size <= 0)
+         size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+#if defined(__linux__)
+      // sysfs knows the caches when libc does not (e.g. on ARM)
+      for (int index = 0; size <= 0 && index < 8; ++index)
+      {
+         char path[96];
+         snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+         FILE* file = fopen(path, "r");
+         if (file == nullptr)
+            continue;
+
+         long value = 0;
+         char unit = 0;
+         if (fscanf(file, "%ld%c", &value, &unit) >= 1)
+            size = (std::max)(size, unit == 'M' ? value << 20 : (unit == 'K' ? value << 10 : value));
+         fclose(file);
+      }
+#endif
+      return size > 0 ? static_cast<size_t>(size) : size_t(32) << 20;
+   }
+};
+
+// Basic statistics over the samples. The input arrays are small (kMaxRepetitions), so the
+// functions sort a copy on stack.
+struct Stats
+{
+   static double Mean(const double* values, int count)
+   {
+      double sum = 0;
+      for (int i = 0; i < count; ++i)
+         sum += values[i];
+      return count > 0 ? sum / count : 0;
+   }
+
+   static double StdDev(const double* values, int count)
+   {
+      if (count < 2)
+         return 0;
+
+      const double mean = Mean(values, count);
+      double sum = 0;
+      for (int i = 0; i < count; ++i)
+         sum += (values[i] - mean) * (values[i] - mean);
+      return std::sqrt(sum / (count - 1));
+   }
+
+   // Percentile in [0..1] with linear interpolation between the closest ranks
+   static double Percentile(const double* values, int count, double percentile)
+   {
+      if (count <= 0)
+         return 0;
+
+      double sorted[2 * kMaxRepetitions];
+      count = (std::min)(count, static_cast<int>(2 * kMaxRepetitions));
+      std::copy_n(values, count, sorted);
+      std::sort(sorted, sorted + count);
+
+      const double pos = percentile * (count - 1);
+      const int lo = static_cast<int>(pos);
+      const int hi = (std::min)(lo + 1, count - 1);
+      return sorted[lo] + (sorted[hi] - sorted[lo]) * (pos - lo);
+   }
+
+   static double Median(const double* values, int count)
+   {
+      return Percentile(values, count, 0.5);
+   }
+};
+
+// Mann-Whitney U test (Wilcoxon rank-sum) of two independent samples. It does not assume normal
+// distribution of timings and is not sensitive to the outliers which are typical for
+// benchmarks. Normal approximation with tie correction is used, so it needs ~5+ samples per side
+// to ever report a significant difference.
+struct MannWhitney
+{
+   double U;      // U statistic for the first sample
+   double Z;      // normalized statistic, positive when the first sample tends to be larger
+   double PValue; // two-sided
+
+   static MannWhitney Test(const double* a, int countA, const double* b, int countB)
+   {
+      MannWhitney res = { 0, 0, 1 };
+      if (countA <= 0 || countB <= 0)
+         return res;
+
+      // Pool the samples to get the ranks, remembering where the value came from
+      struct Ranked { double Value; bool FromA; };
+      Ranked pooled[2 * kMaxRepetitions];
+      countA = (std::min)(countA, static_cast<int>(kMaxRepetitions));
+      countB = (std::min)(countB, static_cast<int>(kMaxRepetitions));
+      int n = 0;
+      for (int i = 0; i < countA; ++i)
+         pooled[n++] = Ranked{ a[i], true };
+      for (int i = 0; i < countB; ++i)
+         pooled[n++] = Ranked{ b[i], false };
+
+      std::sort(pooled, pooled + n,
+         [](const Ranked& l, const Ranked& r) { return l.Value < r.Value; });
+
+      double rankSumA = 0;
+      double tieTerm = 0;
+      for (int i = 0; i < n; )
+      {
+         int j = i;
+         while (j < n && pooled[j].Value == pooled[i].Value)
+            ++j;
+
+         const double rank = (i + j + 1) * 0.5; // average of ranks i+1..j
+         for (int k = i; k < j; ++k)
+            if (pooled[k].FromA)
+               rankSumA += rank;
+
+         const double ties = j - i;
+         tieTerm += ties * ties * ties - ties;
+         i = j;
+      }
+
+      const double na = countA, nb = countB;
+      res.U = rankSumA - na * (na + 1) / 2;
+
+      const double meanU = na * nb / 2;
+      const double varU = na * nb / 12 * ((n + 1) - tieTerm / (n * (n - 1.0)));
+      if (varU <= 0)
+         return res;
+
+      // continuity correction towards the mean
+      const double diff = res.U - meanU;
+      const double corrected = diff > 0 ? diff - 0.5 : (diff < 0 ? diff + 0.5 : 0);
+      res.Z = corrected / std::sqrt(varU);
+      res.PValue = std::erfc(std::fabs(res.Z) / std::sqrt(2.0));
+      return res;
+   }
+};
+
+// Per benchmark configuration
+enum CacheMode_t
+{
+   CacheMode_Warm, // iterations run back to back, the data stays in cache
+   CacheMode_Cold, // caches are evicted before every iteration, reported as 'group:case/cold'
+   CacheMode_Both  // both measurements are reported side by side
+};
+
+enum Evict_t
+{
+   Evict_Buffer,   // touch a buffer sized to the last level cache
+   Evict_Flush     // clflush the working set given with State::SetWorkingSet()
+};
+
+struct Options
+{
+   int         Repetitions;    // number of samples to collect
+   double      MinTimeMs;      // each sample runs the body at least this time
+   Count_t     MaxIterations;  // upper limit of iterations per sample
+   CacheMode_t CacheMode;
+   Evict_t     Evict;
+   Count_t     ColdIterations; // iterations per sample in cold mode, eviction is slow
+
+   Options()
+      : Repetitions(10), MinTimeMs(10), MaxIterations(1000000000), CacheMode(CacheMode_Warm),
+        Evict(Evict_Buffer), ColdIterations(16)
+   {}
+};
+
+// User counter reported with a benchmark, e.g. bytes processed
+struct Counter
+{
+   const char* Name;
+   double      Value;
+};
+
+// Comparison of a benchmark with its baseline
+enum Verdict_t
+{
+   Verdict_None,        // no baseline requested
+   Verdict_New,         // there is no such benchmark in baseline
+   Verdict_Same,        // no significant difference
+   Verdict_Improvement,
+   Verdict_Regression
+};
+
+struct Comparison
+{
+   Verdict_t Verdict;
+   double    BaselineMedianNs;
+   double    Change;  // relative change of median: +0.10 is 10% slower than baseline
+   double    PValue;
+
+   Comparison() : Verdict(Verdict_None), BaselineMedianNs(0), Change(0), PValue(1) {}
+};
+
+// Measurements of one benchmark, times are per iteration
+struct Result
+{
+   const char* Address;
+   Count_t     Iterations;  // per repetition
+   int         Repetitions;
+   double      RealNs[kMaxRepetitions];
+   double      CpuNs[kMaxRepetitions];
+   Counter     Counters[kMaxCounters];
+   int         CounterCount;
+   Comparison  Baseline;
+   bool        HasArg;      // measured in a parameter sweep, the address is 'group:case/arg'
+   Count_t     Arg;
+   const char* ArgName;     // optional, the address is 'group:case/name:arg' then
+   const char* Variant;     // optional suffix of the address, e.g. 'group:case/cold'
+   double      Noise;       // run-to-run noise of the machine measured right after, 0 if unknown
+   bool        Noisy;       // the noise is over Settings::MaxNoise, the result is not reliable
+
+   Result()
+      : Address(""), Iterations(0), Repetitions(0), CounterCount(0), HasArg(false), Arg(0),
+        ArgName(nullptr), Variant(nullptr), Noise(0), Noisy(false)
+   {}
+
+   double MedianNs() const { return Stats::Median(RealNs, Repetitions); }
+   double MedianCpuNs() const { return Stats::Median(CpuNs, Repetitions); }
+};
+
+// Complexity classes to fit the parameter sweep results
+enum Complexity_t
+{
+   Complexity_O1,
+   Complexity_OLogN,
+   Complexity_ON,
+   Complexity_ONLogN,
+   Complexity_ON2,
+   Complexity_Count
+};
+
+inline const char* ComplexityName(Complexity_t complexity)
+{
+   static const char* const kNames[] = { "O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)" };
+   return complexity < Complexity_Count ? kNames[complexity] : "?";
+}
+
+// Least squares fit of time(n) = Coefficient * f(n) for every complexity class
+struct ComplexityFit
+{
+   Complexity_t BestFit;
+   double       Coefficient;             // ns per f(n) of the best fit
+   double       Rms;                     // RMS error of the best fit relative to mean time
+   double       RmsOf[Complexity_Count]; // RMS error of every class
+
+   static double F(Complexity_t complexity, double n)
+   {
+      switch (complexity)
+      {
+      case Complexity_O1:     return 1;
+      case Complexity_OLogN:  return std::log2(n);
+      case Complexity_ON:     return n;
+      case Complexity_ONLogN: return n * std::log2(n);
+      case Complexity_ON2:    return n * n;
+      default:                return 1;
+      }
+   }
+
+   static ComplexityFit Fit(const Count_t* args, const double* timesNs, int count)
+   {
+      ComplexityFit res;
+      res.BestFit = Complexity_O1;
+      res.Coefficient = 0;
+      res.Rms = 0;
+
+      const double mean = Stats::Mean(timesNs, count);
+      for (int c = 0; c < Complexity_Count; ++c)
+      {
+         const Complexity_t complexity = static_cast<Complexity_t>(c);
+
+         double sumTF = 0, sumFF = 0;
+         for (int i = 0; i < count; ++i)
+         {
+            const double f = F(complexity, static_cast<double>(args[i]));
+            sumTF += timesNs[i] * f;
+            sumFF += f * f;
+         }
+         const double coefficient = sumFF > 0 ? sumTF / sumFF : 0;
+
+         double sumErr = 0;
+         for (int i = 0; i < count; ++i)
+         {
+            const double err = timesNs[i] - coefficient * F(complexity, double(args[i]));
+            sumErr += err * err;
+         }
+         res.RmsOf[c] = count > 0 && mean > 0 ? std::sqrt(sumErr / count) / mean : 0;
+
+         if (c == 0 || res.RmsOf[c] < res.Rms)
+         {
+            res.BestFit = complexity;
+            res.Coefficient = coefficient;
+            res.Rms = res.RmsOf[c];
+         }
+      }
+
+      return res;
+   }
+};
+
+// Receives the results of benchmarks, e.g. to produce the machine readable report
+struct IObserver
+{
+   virtual void OnBenchmark(const Result& result) = 0;
+   virtual void OnComplexity(const char* address, const ComplexityFit& fit) {}
+   virtual void OnDone() {}
+};
+
+// Formats nanoseconds with a readable unit: "12.3 ns", "4.56 us", ...
+inline const char* FormatNs(double ns, StringStorage<32>& buf)
+{
+   static const char* const kUnits[] = { "ns", "us", "ms", "s" };
+   int unit = 0;
+   while (std::fabs(ns) >= 1000 && unit < 3)
+   {
+      ns /= 1000;
+      ++unit;
+   }
+   snprintf(buf.Data(), buf.MaxSize(), "%.4g %s", ns, kUnits[unit]);
+   return buf.CData();
+}
+
+// The state passed to benchmark body. The body iterates over the state and the timer is only
+// running inside this loop:
+//
+//    for (auto _: state)
+//       DoNotOptimize(Work());
+//
+struct State
+{
+   // The loop variable is never used, so the type is marked for -Wunused-variable
+   struct [[maybe_unused]] Value {};
+
+   struct Iterator
+   {
+      State*  m_state;
+      Count_t m_left;
+
+      bool operator!=(const Iterator&)
+      {
+         if (m_left != 0)
+         {
+            if (m_state->m_evict)
+               m_state->EvictCaches();
+            return true;
+         }
+         m_state->Stop();
+         return false;
+      }
+      void operator++() { --m_left; }
+      Value operator*() const { return Value(); }
+   };
+
+   Iterator begin() { Start(); return Iterator{ this, m_iterations }; }
+   Iterator end()   { return Iterator{ this, 0 }; }
+
+   // Alternative to range loop: while (state.KeepRunning()) {...}
+   bool KeepRunning()
+   {
+      if (!m_started)
+      {
+         Start();
+         m_left = m_iterations;
+      }
+      if (m_left == 0)
+      {
+         Stop();
+         return false;
+      }
+      if (m_evict)
+         EvictCaches();
+      --m_left;
+      return true;
+   }
+
+   // The memory used by the body, it is flushed from caches in cold mode with Evict_Flush
+   void SetWorkingSet(const void* data, size_t size)
+   {
+      m_workingSet = data;
+      m_workingSetSize = size;
+   }
+
+   Count_t Iterations() const { return m_iterations; }
+
+   // The argument value in parameter sweep, e.g. the input size
+   Count_t Arg() const { return m_arg; }
+
+   // Exclude setup code inside of the loop from measurement
+   void PauseTiming()
+   {
+      if (!m_running)
+         return;
+      m_realNs += Clock::RealNs() - m_realStart;
+      m_cpuNs += Clock::CpuNs() - m_cpuStart;
+      m_running = false;
+   }
+
+   void ResumeTiming()
+   {
+      if (m_running)
+         return;
+      m_running = true;
+      m_cpuStart = Clock::CpuNs();
+      m_realStart = Clock::RealNs();
+   }
+
+   // Set the user counter, the reported value is the average over repetitions. Use literal for
+   // the name because it is not copied.
+   void SetCounter(const char* name, double value)
+   {
+      for (int i = 0; i < m_counterCount; ++i)
+      {
+         if (strcmp(m_counters[i].Name, name) == 0)
+         {
+            m_counters[i].Value = value;
+            return;
+         }
+      }
+      if (m_counterCount < kMaxCounters)
+         m_counters[m_counterCount++] = Counter{ name, value };
+   }
+
+   State()
+      : m_iterations(0), m_arg(0), m_evict(false), m_flush(false), m_workingSet(nullptr),
+        m_workingSetSize(0)
+   {
+      Reset(0);
+   }
+
+   // Private API used by the measurement loop
+   void Reset(Count_t iterations)
+   {
+      m_iterations = iterations;
+      m_left = 0;
+      m_started = m_stopped = m_running = false;
+      m_realNs = m_cpuNs = 0;
+      m_counterCount = 0;
+   }
+
+   void   SetArg(Count_t arg) { m_arg = arg; }
+   void   SetCold(bool cold, Evict_t evict) { m_evict = cold; m_flush = evict == Evict_Flush; }
+   bool   IsCompleted() const { return m_stopped; }
+   double ElapsedRealNs() const { return m_realNs; }
+   double ElapsedCpuNs() const { return m_cpuNs; }
+   int    CounterCount() const { return m_counterCount; }
+   const Counter& GetCounter(int index) const { return m_counters[index]; }
+
+private:
+   void Start()
+   {
+      m_started = true;
+      ResumeTiming();
+   }
+
+   void Stop()
+   {
+      if (m_stopped)
+         return;
+      PauseTiming();
+      m_stopped = true;
+   }
+
+   void EvictCaches()
+   {
+      PauseTiming();
+      if (m_flush && m_workingSet != nullptr)
+         CacheEvictor::Flush(m_workingSet, m_workingSetSize);
+      else
+         CacheEvictor::EvictByBuffer();
+      ResumeTiming();
+   }
+
+   Count_t m_iterations;
+   Count_t m_arg;
+   bool    m_evict;
+   bool    m_flush;
+   const void* m_workingSet;
+   size_t  m_workingSetSize;
+   Count_t m_left;
+   bool    m_started;
+   bool    m_stopped;
+   bool    m_running;
+   double  m_realStart;
+   double  m_cpuStart;
+   double  m_realNs;
+   double  m_cpuNs;
+   Counter m_counters[kMaxCounters];
+   int     m_counterCount;
+};
+
+// Baseline file is a text file, one benchmark per line:
+//
+//    <address>\t<iterations>\t<repetitions>\t<ns> <ns> ...
+//
+// It is small enough to be scanned for every lookup, so nothing is kept in memory.
+struct BaselineFile
+{
+   static bool Load(const char* path, const char* address, Result& out)
+   {
+      FILE* file = fopen(path, "r");
+      if (file == nullptr)
+         return false;
+
+      bool found = false;
+      char line[kMaxAddress + kMaxRepetitions * 32];
+      const size_t addressLen = strlen(address);
+      while (!found && fgets(line, sizeof(line), file) != nullptr)
+      {
+         if (strncmp(line, address, addressLen) != 0 || line[addressLen] != '\t')
+            continue;
+
+         char* cursor = line + addressLen + 1;
+         out.Iterations = strtoll(cursor, &cursor, 10);
+         const long count = strtol(cursor, &cursor, 10);
+         out.Repetitions = 0;
+         while (out.Repetitions < count && out.Repetitions < kMaxRepetitions)
+         {
+            char* next = nullptr;
+            const double value = strtod(cursor, &next);
+            if (next == cursor)
+               break;
+            out.RealNs[out.Repetitions] = out.CpuNs[out.Repetitions] = value;
+            ++out.Repetitions;
+            cursor = next;
+         }
+         found = out.Repetitions > 0;
+      }
+
+      fclose(file);
+      return found;
+   }
+
+   static void Write(FILE* file, const Result& result)
+   {
+      fprintf(file, "%s\t%lld\t%d\t",
+         result.Address, static_cast<long long>(result.Iterations), result.Repetitions);
+      for (int i = 0; i < result.Repetitions; ++i)
+         fprintf(file, i == 0 ? "%.17g" : " %.17g", result.RealNs[i]);
+      fprintf(file, "\n");
+   }
+};
+
+// The state of the machine which affects the benchmarks. Values which are not available on the
+// platform stay unknown (empty string, -1).
+struct Environment
+{
+   StringStorage<32> Governor;  // cpufreq scaling governor of cpu0, e.g. "performance"
+   int    Turbo;                // 1 if turbo boost is enabled, 0 disabled, -1 unknown
+   double LoadAverage;          // 1 minute load average at start, -1 unknown
+   int    CpuCount;             // online cpus
+   int    AffinityCount;        // cpus this process is allowed to run on, -1 unknown
+   int    PinnedCpu;            // the cpu the benchmark thread was pinned to, -1 not pinned
+   bool   RaisedPriority;       // priority of benchmark thread is raised
+   double Noise;                // calibration kernel noise: robust coefficient of variation
+#if defined(__linux__)
+   cpu_set_t UnpinnedSet;       // affinity of the benchmark thread before PinTo()
+#endif
+
+   Environment()
+      : Turbo(-1), LoadAverage(-1), CpuCount(1), AffinityCount(-1), PinnedCpu(-1),
+        RaisedPriority(false), Noise(0)
+   {}
+
+   bool IsPinned() const { return PinnedCpu >= 0 || AffinityCount == 1; }
+
+   static Environment Detect()
+   {
+      Environment env;
+      env.CpuCount = (std::max)(1, static_cast<int>(std::thread::hardware_concurrency()));
+#if defined(__linux__)
+      env.CpuCount = (std::max)(1, static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)));
+      ReadLine("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor", env.Governor);
+
+      StringStorage<32> value;
+      if (ReadLine("/sys/devices/system/cpu/intel_pstate/no_turbo", value))
+         env.Turbo = atoi(value.CData()) == 0 ? 1 : 0;
+      else if (ReadLine("/sys/devices/system/cpu/cpufreq/boost", value))
+         env.Turbo = atoi(value.CData()) != 0 ? 1 : 0;
+
+      if (ReadLine("/proc/loadavg", value))
+         env.LoadAverage = atof(value.CData());
+
+      cpu_set_t set;
+      if (sched_getaffinity(0, sizeof(set), &set) == 0)
+         env.AffinityCount = CPU_COUNT(&set);
+#endif
+      return env;
+   }
+
+   // Pins the calling thread to the cpu, false if not supported or not allowed
+   bool PinTo(int cpu)
+   {
+#if defined(__linux__)
+      cpu_set_t set;
+      if (PinnedCpu < 0 && sched_getaffinity(0, sizeof(UnpinnedSet), &UnpinnedSet) != 0)
+         return false;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      if (sched_setaffinity(0, sizeof(set), &set) != 0)
+         return false;
+      PinnedCpu = cpu;
+      AffinityCount = 1;
+      return true;
+#else
+      (void)cpu;
+      return false;
+#endif
+   }
+
+   // The threads created by the pinned benchmark thread inherit its affinity, they call this to
+   // run on the cpus the benchmark thread had before PinTo()
+   void Unpin() const
+   {
+#if defined(__linux__)
+      if (PinnedCpu >= 0)
+         sched_setaffinity(0, sizeof(UnpinnedSet), &UnpinnedSet);
+#endif
+   }
+
+   // Raises the scheduling priority of calling thread: the lowest real-time (FIFO) priority if
+   // permitted, otherwise the highest nice value allowed. Returns false if neither is allowed.
+   bool RaisePriority()
+   {
+#if defined(__linux__)
+      sched_param param;
+      param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+      RaisedPriority = sched_setscheduler(0, SCHED_FIFO, &param) == 0
+         || setpriority(PRIO_PROCESS, 0, -10) == 0;
+#endif
+      return RaisedPriority;
+   }
+
+   // Measures the noise with fixed calibration kernel: it should take the same time on every
+   // run, so the spread of its timings is the noise the machine adds to benchmarks. The spread
+   // is (p90 - p10) / median which tolerates single outliers, takes ~2ms.
+   static double MeasureNoise(int samples = 21)
+   {
+      double timings[kMaxRepetitions];
+      samples = (std::max)(3, (std::min)(samples, int(kMaxRepetitions)));
+      for (int i = 0; i < samples; ++i)
+      {
+         const double start = Clock::RealNs();
+         uint64_t x = 88172645463325252ull;
+         for (int k = 0; k < 20000; ++k)
+         {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+         }
+         DoNotOptimize(x);
+         timings[i] = Clock::RealNs() - start;
+      }
+
+      const double median = Stats::Median(timings, samples);
+      return median > 0 ?
+         (Stats::Percentile(timings, samples, 0.9) - Stats::Percentile(timings, samples, 0.1))
+            / median : 0;
+   }
+
+   void Print() const
+   {
+      printf("Benchmark environment:\n");
+      printf("   cpus: %d, allowed: %d, pinned: %s\n",
+         CpuCount, AffinityCount,
+         PinnedCpu >= 0 ? "yes (by session)" : (IsPinned() ? "yes" : "no"));
+      printf("   governor: %s%s\n", Governor.Empty() ? "unknown" : Governor.CData(),
+         !Governor.Empty() && strcmp(Governor.CData(), "performance") != 0 ?
+            " (WARNING: frequency scaling, use 'performance')" : "");
+      printf("   turbo: %s\n", Turbo < 0 ? "unknown" :
+         (Turbo ? "enabled (WARNING: frequency depends on temperature)" : "disabled"));
+      if (LoadAverage >= 0)
+         printf("   load average: %.2f%s\n", LoadAverage,
+            LoadAverage > 0.1 * CpuCount + 0.5 ? " (WARNING: machine is busy)" : "");
+      printf("   priority: %s\n", RaisedPriority ? "raised" : "normal");
+      printf("   calibration noise: %.1f%%\n", Noise * 100);
+   }
+
+private:
+   template <size_t SizeP>
+   static bool ReadLine(const char* path, StringStorage<SizeP>& value)
+   {
+      FILE* file = fopen(path, "r");
+      if (file == nullptr)
+         return false;
+
+      const bool read = fgets(value.Data(), static_cast<int>(value.MaxSize()), file) != nullptr;
+      fclose(file);
+      if (!read)
+         value.Assign("");
+      value.Data()[strcspn(value.CData(), "\r\n")] = 0;
+      return read;
+   }
+};
+
+// Benchmark run configuration owned by the test runner app
+struct Settings
+{
+   const char* BaselineIn;           // compare the results with this baseline file
+   const char* BaselineOut;          // save the results to this baseline file
+   double      Alpha;                // significance level of Mann-Whitney test
+   double      RegressionThreshold;  // relative slowdown of median to count as regression
+   double      ImprovementThreshold; // relative speedup of median to count as improvement
+   bool        FailOnRegression;     // regression fails the case
+   bool        Quiet;                // do not print results to stdout
+   int         Repetitions;          // overrides Options::Repetitions of benchmarks when > 0
+   bool        CheckEnvironment;     // report the environment and measure noise of results
+   double      MaxNoise;             // results measured with more noise are flagged
+   int         PinCpu;               // pin the benchmark thread to this cpu when >= 0
+   bool        RaisePriority;        // raise the priority of benchmark thread when allowed
+
+   Settings()
+      : BaselineIn(nullptr), BaselineOut(nullptr), Alpha(0.01), RegressionThreshold(0.05),
+        ImprovementThreshold(0.05), FailOnRegression(true), Quiet(false), Repetitions(0),
+        CheckEnvironment(true), MaxNoise(0.05), PinCpu(-1), RaisePriority(false)
+   {}
+};
+
+// The run observer decorator that keeps the benchmark context of the test run. The test runner
+// creates it around the regular observer:
+//
+//    tested::bench::Settings settings;
+//    settings.BaselineIn = "baseline.txt";
+//    tested::bench::Session session(settings);
+//    tests.Run(&session);
+//
+struct Session final: Subset::IRunObserver
+{
+   Session(const Settings& settings = Settings(),
+      Subset::IRunObserver* caseObserver = nullptr,
+      IObserver* benchObserver = nullptr)
+      : m_settings(settings), m_caseObserver(caseObserver), m_benchObserver(benchObserver),
+        m_baselineOut(nullptr), m_previous(CurrentRef()), m_groupName(""), m_benchmarks(0),
+        m_regressions(0), m_improvements(0), m_noisy(0)
+   {
+      if (m_caseObserver == nullptr)
+         m_caseObserver = &m_stdoutReporter;
+
+      if (m_settings.BaselineOut != nullptr)
+      {
+         MakeTempPath();
+         m_baselineOut = fopen(m_tempPath.CData(), "w");
+      }
+
+      // Pinning and priority apply also when the environment is not checked
+      if (m_settings.CheckEnvironment)
+         m_environment = Environment::Detect();
+      if (m_settings.PinCpu >= 0 && !m_environment.PinTo(m_settings.PinCpu))
+         printf("Failed to pin benchmarks to cpu %d\n", m_settings.PinCpu);
+      if (m_settings.RaisePriority && !m_environment.RaisePriority())
+         printf("Not allowed to raise the priority of benchmarks\n");
+      if (m_settings.CheckEnvironment)
+         CheckEnvironment();
+
+      CurrentRef() = this;
+   }
+
+   ~Session()
+   {
+      Finish();
+      CurrentRef() = m_previous;
+   }
+
+   // The session of the running tests, nullptr if runner does not use benchmark session
+   static Session* Current() { return CurrentRef(); }
+
+   const Settings& GetSettings() const { return m_settings; }
+   const Environment& GetEnvironment() const { return m_environment; }
+   const char* CurrentAddress() const { return m_address.CData(); }
+
+   int Benchmarks() const   { return m_benchmarks; }
+   int Regressions() const  { return m_regressions; }
+   int Improvements() const { return m_improvements; }
+
+   // Completes the baseline file and prints the summary, invoked by destructor as well
+   void Finish()
+   {
+      if (m_baselineOut != nullptr)
+      {
+         fclose(m_baselineOut);
+         m_baselineOut = nullptr;
+         if (!MoveOver(m_tempPath.CData(), m_settings.BaselineOut))
+            printf("Failed to save benchmark baseline '%s'\n", m_settings.BaselineOut);
+      }
+
+      if (m_benchObserver != nullptr)
+      {
+         m_benchObserver->OnDone();
+         m_benchObserver = nullptr;
+      }
+
+      if (!m_settings.Quiet && m_settings.BaselineIn != nullptr && m_benchmarks > 0)
+         printf("\nBenchmarks: %d, regressions: %d, improvements: %d\n",
+            m_benchmarks, m_regressions, m_improvements);
+
+      if (!m_settings.Quiet && m_noisy > 0)
+         printf("\nWARNING: %d of %d benchmarks measured with noise over %.1f%%\n",
+            m_noisy, m_benchmarks, m_settings.MaxNoise * 100);
+
+      m_benchmarks = 0;
+      m_noisy = 0;
+   }
+
+   // Invoked by bench::Run() when benchmark is measured. Returns the comparison with baseline.
+   const Comparison& Report(Result& result)
+   {
+      result.Address = m_address.CData();
+      if (result.HasArg || result.Variant != nullptr)
+      {
+         FormatAddress(result, m_address.CData(), m_resultAddress);
+         result.Address = m_resultAddress.CData();
+      }
+      ++m_benchmarks;
+
+      if (m_settings.CheckEnvironment)
+      {
+         result.Noise = Environment::MeasureNoise();
+         result.Noisy = result.Noise > m_settings.MaxNoise;
+         m_noisy += result.Noisy ? 1 : 0;
+      }
+
+      if (m_settings.BaselineIn != nullptr)
+         Compare(result);
+
+      if (m_baselineOut != nullptr)
+         BaselineFile::Write(m_baselineOut, result);
+
+      if (m_benchObserver != nullptr)
+         m_benchObserver->OnBenchmark(result);
+
+      if (!m_settings.Quiet)
+         Print(result);
+
+      return result.Baseline;
+   }
+
+   // 'group:case[/[name:]arg][/variant]'
+   static void FormatAddress(const Result& result, const char* caseAddress,
+      StringStorage<kMaxAddress>& address)
+   {
+      StringStorage<32> arg;
+      if (result.HasArg)
+         snprintf(arg.Data(), arg.MaxSize(), "/%s%s%lld",
+            result.ArgName != nullptr ? result.ArgName : "",
+            result.ArgName != nullptr ? ":" : "",
+            static_cast<long long>(result.Arg));
+
+      snprintf(address.Data(), address.MaxSize(), "%s%s%s%s",
+         caseAddress,
+         arg.CData(),
+         result.Variant != nullptr ? "/" : "",
+         result.Variant != nullptr ? result.Variant : "");
+   }
+
+   // Invoked by bench::Sweep() when all argument values are measured
+   void ReportComplexity(const ComplexityFit& fit)
+   {
+      if (m_benchObserver != nullptr)
+         m_benchObserver->OnComplexity(m_address.CData(), fit);
+
+      if (!m_settings.Quiet)
+         PrintComplexity(m_address.CData(), fit);
+   }
+
+   static void PrintComplexity(const char* address, const ComplexityFit& fit)
+   {
+      printf("   %s: best fit %s, rms %.1f%%\n",
+         address, ComplexityName(fit.BestFit), fit.Rms * 100);
+   }
+
+   static void Print(const Result& result)
+   {
+      StringStorage<32> median, cpu;
+      printf("   %s: %s/op (cpu %s), %lld iterations x %d\n",
+         result.Address,
+         FormatNs(result.MedianNs(), median),
+         FormatNs(result.MedianCpuNs(), cpu),
+         static_cast<long long>(result.Iterations),
+         result.Repetitions);
+
+      for (int i = 0; i < result.CounterCount; ++i)
+         printf("      %s = %g\n", result.Counters[i].Name, result.Counters[i].Value);
+
+      if (result.Noisy)
+         printf("      NOISY: machine noise %.1f%%, the result is not reliable\n",
+            result.Noise * 100);
+
+      const Comparison& cmp = result.Baseline;
+      switch (cmp.Verdict)
+      {
+      case Verdict_None: break;
+      case Verdict_New:  printf("      not in baseline\n"); break;
+      default:
+         printf("      %s: %+.1f%% vs baseline %s, p=%.4f\n",
+            cmp.Verdict == Verdict_Regression ? "REGRESSION" :
+               (cmp.Verdict == Verdict_Improvement ? "improvement" : "same"),
+            cmp.Change * 100,
+            FormatNs(cmp.BaselineMedianNs, median),
+            cmp.PValue);
+      }
+   }
+
+   // IRunObserver
+   void OnGroupStart(const char* groupName) override
+   {
+      m_groupName = groupName;
+      m_caseObserver->OnGroupStart(groupName);
+   }
+
+   void OnCaseStart(StartedCase caseInfo) override
+   {
+      if (caseInfo.RowName != nullptr)
+         snprintf(m_address.Data(), m_address.MaxSize(), "%s:%s<%s>", m_groupName, caseInfo.Name,
+            caseInfo.RowName);
+      else if (caseInfo.Row >= 0)
+         snprintf(m_address.Data(), m_address.MaxSize(), "%s:%s[%d]", m_groupName, caseInfo.Name,
+            caseInfo.Row);
+      else
+         snprintf(m_address.Data(), m_address.MaxSize(), "%s:%s", m_groupName, caseInfo.Name);
+      m_caseObserver->OnCaseStart(caseInfo);
+   }
+
+   void OnCaseDone(CaseResult_t code, const char* message) override
+   {
+      m_caseObserver->OnCaseDone(code, message);
+   }
+
+   void OnResourceBuilt(const char* resourceName, double milliseconds) override
+   {
+      m_caseObserver->OnResourceBuilt(resourceName, milliseconds);
+   }
+
+   void OnScratchLeftovers(long long bytes, int files) override
+   {
+      m_caseObserver->OnScratchLeftovers(bytes, files);
+   }
+
+   void OnCaseSlept(double milliseconds) override
+   {
+      m_caseObserver->OnCaseSlept(milliseconds);
+   }
+
+private:
+   // Replaces the target at once, so the failure keeps the previous file
+   static bool MoveOver(const char* source, const char* target)
+   {
+#if defined(_WIN32)
+      return MoveFileExA(source, target, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+      return rename(source, target) == 0;
+#endif
+   }
+
+   void CheckEnvironment()
+   {
+      m_environment.Noise = Environment::MeasureNoise();
+      if (!m_settings.Quiet)
+         m_environment.Print();
+   }
+
+   static Session*& CurrentRef()
+   {
+      static Session* s_current = nullptr;
+      return s_current;
+   }
+
+   void MakeTempPath()
+   {
+      snprintf(m_tempPath.Data(), m_tempPath.MaxSize(), "%s.tmp", m_settings.BaselineOut);
+   }
+
+   void Compare(Result& result)
+   {
+      Comparison& cmp = result.Baseline;
+
+      Result baseline;
+      if (!BaselineFile::Load(m_settings.BaselineIn, result.Address, baseline))
+      {
+         cmp.Verdict = Verdict_New;
+         return;
+      }
+
+      cmp.BaselineMedianNs = baseline.MedianNs();
+      cmp.Change = cmp.BaselineMedianNs > 0 ?
+         result.MedianNs() / cmp.BaselineMedianNs - 1 : 0;
+      cmp.PValue = MannWhitney::Test(result.RealNs, result.Repetitions,
+         baseline.RealNs, baseline.Repetitions).PValue;
+
+      cmp.Verdict = Verdict_Same;
+      if (cmp.PValue < m_settings.Alpha)
+      {
+         if (cmp.Change > m_settings.RegressionThreshold)
+         {
+            cmp.Verdict = Verdict_Regression;
+            ++m_regressions;
+         }
+         else if (cmp.Change < -m_settings.ImprovementThreshold)
+         {
+            cmp.Verdict = Verdict_Improvement;
+            ++m_improvements;
+         }
+      }
+   }
+
+   Settings                m_settings;
+   Subset::IRunObserver*   m_caseObserver;
+   IObserver*              m_benchObserver;
+   Subset::StdoutReporter  m_stdoutReporter;
+   FILE*                   m_baselineOut;
+   StringStorage<512>      m_tempPath;
+   Session*                m_previous;
+   const char*             m_groupName;
+   StringStorage<kMaxAddress> m_address;
+   StringStorage<kMaxAddress> m_resultAddress;
+   int                     m_benchmarks;
+   int                     m_regressions;
+   int                     m_improvements;
+   int                     m_noisy;
+   Environment             m_environment;
+};
+
+// Reports the result to the session (or stdout when there is no session) and fails the case on
+// regression.
+inline void Report(Result& result)
+{
+   Session* session = Session::Current();
+   if (session == nullptr)
+   {
+      result.Address = "<no bench::Session>";
+      Session::Print(result);
+      return;
+   }
+
+   const Comparison& cmp = session->Report(result);
+   if (cmp.Verdict == Verdict_Regression && session->GetSettings().FailOnRegression)
+   {
+      StringStorage<32> median, baseline;
+      StringStorage<256> message;
+      snprintf(message.Data(), message.MaxSize(),
+         "Benchmark regression: median %s/op vs baseline %s/op (%+.1f%%), p=%.4f",
+         FormatNs(result.MedianNs(), median),
+         FormatNs(cmp.BaselineMedianNs, baseline),
+         cmp.Change * 100,
+         cmp.PValue);
+      Fail(message.CData());
+   }
+}
+
+// Runs the body once with given number of iterations, returns the elapsed real time
+template <typename BodyT>
+inline double RunIterations(State& state, BodyT& body, Count_t iterations)
+{
+   state.Reset(iterations);
+   body(state);
+   if (!state.IsCompleted())
+      Fail("Benchmark body must iterate over the bench::State");
+   return state.ElapsedRealNs();
+}
+
+// Finds the number of iterations which takes at least options.MinTimeMs. This also warms up.
+template <typename BodyT>
+inline Count_t CalibrateIterations(State& state, BodyT& body, const Options& options)
+{
+   const double minTimeNs = options.MinTimeMs * 1e6;
+
+   Count_t iterations = 1;
+   while (iterations < options.MaxIterations)
+   {
+      const double elapsed = RunIterations(state, body, iterations);
+      if (elapsed >= minTimeNs)
+         break;
+
+      // Grow towards the target, but not too aggressively because the first runs are noisy
+      const double factor = elapsed > 0 ? (std::min)(10.0, 1.4 * minTimeNs / elapsed) : 10.0;
+      const Count_t next = static_cast<Count_t>(iterations * (std::max)(2.0, factor));
+      iterations = (std::min)(next, options.MaxIterations);
+   }
+
+   return iterations;
+}
+
+// Measures the benchmark body into the result without reporting
+template <typename BodyT>
+inline void Measure(BodyT& body, const Options& options, Result& result)
+{
+   State state;
+   state.SetArg(result.Arg);
+
+   // Eviction time is excluded, but it is still slow, so cold mode has fixed iterations
+   const bool cold = result.Variant != nullptr && strcmp(result.Variant, "cold") == 0;
+   state.SetCold(cold, options.Evict);
+   const Count_t iterations = cold ?
+      (std::max)(Count_t(1), options.ColdIterations) : CalibrateIterations(state, body, options);
+
+   result.Iterations = iterations;
+   result.Repetitions = (std::max)(1, (std::min)(options.Repetitions, int(kMaxRepetitions)));
+
+   double counterSums[kMaxCounters] = {};
+   for (int r = 0; r < result.Repetitions; ++r)
+   {
+      RunIterations(state, body, iterations);
+      result.RealNs[r] = state.ElapsedRealNs() / iterations;
+      result.CpuNs[r] = state.ElapsedCpuNs() / iterations;
+
+      result.CounterCount = state.CounterCount();
+      for (int i = 0; i < state.CounterCount(); ++i)
+      {
+         result.Counters[i].Name = state.GetCounter(i).Name;
+         counterSums[i] += state.GetCounter(i).Value;
+      }
+   }
+
+   for (int i = 0; i < result.CounterCount; ++i)
+      result.Counters[i].Value = counterSums[i] / result.Repetitions;
+}
+
+// Measures and reports the warm and/or cold cache results according to options.CacheMode. The
+// result is the template with argument, it gets the warm measurement unless mode is cold only.
+template <typename BodyT>
+inline void MeasureAndReport(BodyT& body, const Options& options, Result& result)
+{
+   Result cold = result;
+   cold.Variant = "cold";
+
+   if (options.CacheMode != CacheMode_Cold)
+   {
+      Measure(body, options, result);
+      Report(result);
+   }
+
+   if (options.CacheMode != CacheMode_Warm)
+   {
+      Measure(body, options, cold);
+      Report(cold);
+   }
+
+   if (options.CacheMode == CacheMode_Both)
+   {
+      const Session* session = Session::Current();
+      if (session == nullptr || !session->GetSettings().Quiet)
+      {
+         StringStorage<32> warmNs, coldNs;
+         printf("      warm %s/op, cold %s/op (x%.2f)\n",
+            FormatNs(result.MedianNs(), warmNs),
+            FormatNs(cold.MedianNs(), coldNs),
+            result.MedianNs() > 0 ? cold.MedianNs() / result.MedianNs() : 0);
+      }
+   }
+
+   if (options.CacheMode == CacheMode_Cold)
+      result = cold;
+}
+
+// Runs the benchmark body, the main API for benchmark cases. Runtime is the one given to the
+// case, the body is callable with bench::State& parameter.
+template <typename BodyT>
+inline void Run(IRuntime* runtime, BodyT body, const Options& options = Options())
+{
+   (void)runtime;
+
+   Options effective = options;
+   const Session* session = Session::Current();
+   if (session != nullptr && session->GetSettings().Repetitions > 0)
+      effective.Repetitions = session->GetSettings().Repetitions;
+
+   Result result;
+   MeasureAndReport(body, effective, result);
+}
+
+// Run observer that prints nothing, for the runs where stdout is a machine readable protocol
+struct SilentObserver final: Subset::IRunObserver
+{
+   void OnGroupStart(const char*) override {}
+   void OnCaseStart(StartedCase) override {}
+   void OnCaseDone(CaseResult_t, const char*) override {}
+};
+
+// Interleaved A/B comparison of two test binaries, e.g. the build before and after a change.
+//
+// Sequential before/after runs are affected by the thermal state and neighbour load which drift
+// over minutes. Here both binaries run the same benchmark in alternating rounds (A,B then B,A),
+// so the drift affects both sides equally and the paired per-round difference cancels it out.
+//
+// The test runner app forwards the command line to AbWorker::Handle() to let the driver talk to
+// it, the protocol on stdout is:
+//
+//    <binary> --tested-list                 ->  "tested-case\t<address>" per case in catalog
+//    <binary> --tested-ab <address> <reps>  ->  "tested-ab\t<address>\t<ns/op>" per repetition
+//
+// The catalog export is used to match the cases of two binaries by address.
+struct AbWorker
+{
+   // Returns true if command line is for the A/B worker, exitCode is set then
+   static bool Handle(int argc, const char* argv[], int& exitCode)
+   {
+      if (argc >= 2 && strcmp(argv[1], "--tested-list") == 0)
+      {
+         CatalogPrinter printer;
+         exitCode = Export(&printer);
+         return true;
+      }
+
+      if (argc >= 4 && strcmp(argv[1], "--tested-ab") == 0)
+      {
+         exitCode = RunOne(argv[2], atoi(argv[3]));
+         return true;
+      }
+
+      return false;
+   }
+
+private:
+   struct CatalogPrinter final: Subset::ICaseExporter
+   {
+      const char* m_groupName = "";
+
+      void OnGroup(const char* groupName, const char*) override { m_groupName = groupName; }
+
+      void OnCase(const ExportedCase& testCase) override
+      {
+         if (testCase.RowName != nullptr)
+            printf("tested-case\t%s:%s<%s>\n", m_groupName, testCase.CaseName, testCase.RowName);
+         else if (testCase.Row >= 0)
+            printf("tested-case\t%s:%s[%d]\n", m_groupName, testCase.CaseName, testCase.Row);
+         else
+            printf("tested-case\t%s:%s\n", m_groupName, testCase.CaseName);
+      }
+
+      void OnDone() override {}
+   };
+
+   struct SampleWriter final: IObserver
+   {
+      void OnBenchmark(const Result& result) override
+      {
+         for (int i = 0; i < result.Repetitions; ++i)
+            printf("tested-ab\t%s\t%.17g\n", result.Address, result.RealNs[i]);
+      }
+   };
+
+   static int Export(Subset::ICaseExporter* exporter)
+   {
+      try
+      {
+         Subset all = Storage::Instance().GetAll();
+         all.Export(exporter);
+         return 0;
+      }
+      catch (const std::exception& ex)
+      {
+         fprintf(stderr, "%s\n", ex.what());
+         return 1;
+      }
+   }
+
+   static int RunOne(const char* address, int repetitions)
+   {
+      Settings settings;
+      settings.Quiet = true;
+      settings.Repetitions = (std::max)(1, repetitions);
+
+      SilentObserver silent;
+      SampleWriter writer;
+      try
+      {
+         Session session(settings, &silent, &writer);
+         Storage::Instance().ByAddress(address).Run(&session);
+         return 0;
+      }
+      catch (const std::exception& ex)
+      {
+         fprintf(stderr, "%s\n", ex.what());
+         return 1;
+      }
+   }
+};
+
+// Two-sided 97.5% quantile of Student t distribution (for 95% confidence interval), Cornish-Fisher
+// expansion around the normal quantile is precise enough for degrees > 2.
+inline double StudentT975(int degrees)
+{
+   static const double kSmall[] = { 0, 12.706, 4.303, 3.182 };
+   if (degrees <= 0)
+      return 0;
+   if (degrees <= 3)
+      return kSmall[degrees];
+
+   const double z = 1.959964;
+   const double v = degrees;
+   const double z3 = z * z * z, z5 = z3 * z * z;
+   return z + (z3 + z) / (4 * v) + (5 * z5 + 16 * z3 + 3 * z) / (96 * v * v);
+}
+
+// Paired difference of B vs A for one benchmark
+struct AbResult
+{
+   const char* Address;
+   int         Rounds;
+   double      MedianA;     // ns/op
+   double      MedianB;     // ns/op
+   double      MeanChange;  // mean of (B - A) / A over rounds, +0.10 is B 10% slower
+   double      ChangeLow;   // 95% confidence interval of the mean change
+   double      ChangeHigh;
+
+   bool IsSignificant() const { return ChangeLow > 0 || ChangeHigh < 0; }
+};
+
+struct AbOptions
+{
+   int Rounds;              // number of interleaved A/B rounds
+   int RepetitionsPerRound; // samples taken by binary in one round, median is used
+
+   AbOptions() : Rounds(10), RepetitionsPerRound(3) {}
+};
+
+// The driver side of interleaved A/B comparison
+struct AbDriver
+{
+   // Receives the paired results
+   struct IObserver
+   {
+      virtual void OnResult(const AbResult& result) = 0;
+   };
+
+   AbDriver(const char* binaryA, const char* binaryB, const AbOptions& options = AbOptions())
+      : m_binaryA(binaryA), m_binaryB(binaryB), m_options(options)
+   {}
+
+   // Compares all benchmarks which are in both catalogs, returns number of benchmarks where B
+   // is significantly slower.
+   int Run(IObserver* observer = nullptr)
+   {
+      if (!List(m_binaryA, m_catalogA) || !List(m_binaryB, m_catalogB))
+         return -1;
+
+      int slower = 0;
+      for (const char* address = m_catalogA.First(); address != nullptr;
+         address = m_catalogA.Next(address))
+      {
+         if (!m_catalogB.Contains(address))
+            continue;
+
+         // Sweep and scaling cases report several benchmarks, these are paired one by one
+         Collect(address);
+         for (int i = 0; i < m_samples.Count; ++i)
+         {
+            AbResult result;
+            if (!Pair(i, result))
+               continue;
+
+            if (observer != nullptr)
+               observer->OnResult(result);
+            else
+               Print(result);
+
+            if (result.IsSignificant() && result.MeanChange > 0)
+               ++slower;
+         }
+      }
+      return slower;
+   }
+
+   static void Print(const AbResult& result)
+   {
+      StringStorage<32> a, b;
+      printf("%s: A %s/op, B %s/op, B-A %+.2f%% [%+.2f%%, %+.2f%%] 95%% CI, %d rounds%s\n",
+         result.Address,
+         FormatNs(result.MedianA, a),
+         FormatNs(result.MedianB, b),
+         result.MeanChange * 100,
+         result.ChangeLow * 100,
+         result.ChangeHigh * 100,
+         result.Rounds,
+         result.IsSignificant() ? (result.MeanChange > 0 ? " SLOWER" : " FASTER") : "");
+   }
+
+private:
+   // Addresses of a binary catalog packed one after another in fixed buffer
+   struct Catalog
+   {
+      char   m_buf[32 * 1024];
+      size_t m_size = 0;
+
+      void Add(const char* address)
+      {
+         const size_t len = strlen(address) + 1;
+         if (m_size + len + 1 > sizeof(m_buf))
+            return;
+         memcpy(m_buf + m_size, address, len);
+         m_size += len;
+      }
+
+      const char* First() const { return m_size > 0 ? m_buf : nullptr; }
+
+      const char* Next(const char* address) const
+      {
+         const char* next = address + strlen(address) + 1;
+         return next < m_buf + m_size ? next : nullptr;
+      }
+
+      bool Contains(const char* address) const
+      {
+         for (const char* it = First(); it != nullptr; it = Next(it))
+            if (strcmp(it, address) == 0)
+               return true;
+         return false;
+      }
+   };
+
+   static FILE* OpenPipe(const char* command)
+   {
+#if defined(_WIN32)
+      return _popen(command, "r");
+#else
+      return popen(command, "r");
+#endif
+   }
+
+   static void ClosePipe(FILE* pipe)
+   {
+#if defined(_WIN32)
+      _pclose(pipe);
+#else
+      pclose(pipe);
+#endif
+   }
+
+   // Reads the lines "<prefix>\t<address>[\t<value>]" from the binary output
+   template <typename OnLineT>
+   static bool ReadLines(const char* binary, const char* args, const char* prefix, OnLineT onLine)
+   {
+      StringStorage<1024> command;
+      snprintf(command.Data(), command.MaxSize(), "\"%s\" %s", binary, args);
+
+      FILE* pipe = OpenPipe(command.CData());
+      if (pipe == nullptr)
+      {
+         printf("Failed to start '%s'\n", command.CData());
+         return false;
+      }
+
+      const size_t prefixLen = strlen(prefix);
+      char line[kMaxAddress + 64];
+      while (fgets(line, sizeof(line), pipe) != nullptr)
+      {
+         if (strncmp(line, prefix, prefixLen) != 0 || line[prefixLen] != '\t')
+            continue;
+
+         char* address = line + prefixLen + 1;
+         address[strcspn(address, "\r\n")] = 0;
+         char* value = strchr(address, '\t');
+         if (value != nullptr)
+            *value++ = 0;
+         onLine(address, value);
+      }
+
+      ClosePipe(pipe);
+      return true;
+   }
+
+   static bool List(const char* binary, Catalog& catalog)
+   {
+      return ReadLines(binary, "--tested-list", "tested-case",
+         [&](const char* address, const char*) { catalog.Add(address); });
+   }
+
+   // Per round medians of the benchmarks reported by one case on both sides
+   struct CaseSamples
+   {
+      int    Count;
+      StringStorage<kMaxAddress> Addresses[kMaxSweepPoints];
+      int    Rounds[2][kMaxSweepPoints];
+      double Medians[2][kMaxSweepPoints][kMaxRepetitions];
+
+      // Samples of the current round before they are reduced to median
+      int    RoundCount[kMaxSweepPoints];
+      double RoundSamples[kMaxSweepPoints][kMaxRepetitions];
+
+      int Find(const char* address)
+      {
+         for (int i = 0; i < Count; ++i)
+            if (strcmp(Addresses[i].CData(), address) == 0)
+               return i;
+
+         if (Count == kMaxSweepPoints)
+            return -1;
+
+         Addresses[Count].Assign(address);
+         Rounds[0][Count] = Rounds[1][Count] = 0;
+         return Count++;
+      }
+   };
+
+   // Runs one round of the case on one side, side 0 is A and 1 is B
+   void Sample(int side, const char* address)
+   {
+      const char* binary = side == 0 ? m_binaryA : m_binaryB;
+
+      StringStorage<kMaxAddress + 32> args;
+      snprintf(args.Data(), args.MaxSize(), "--tested-ab \"%s\" %d",
+         address, m_options.RepetitionsPerRound);
+
+      std::fill_n(m_samples.RoundCount, int(kMaxSweepPoints), 0);
+      // Each sweep point or thread count has its own address and its own median
+      ReadLines(binary, args.CData(), "tested-ab", [&](const char* reported, const char* value)
+      {
+         if (value == nullptr)
+            return;
+         const int index = m_samples.Find(reported);
+         if (index >= 0 && m_samples.RoundCount[index] < kMaxRepetitions)
+            m_samples.RoundSamples[index][m_samples.RoundCount[index]++] = atof(value);
+      });
+
+      for (int i = 0; i < m_samples.Count; ++i)
+      {
+         if (m_samples.RoundCount[i] == 0 || m_samples.Rounds[side][i] >= kMaxRepetitions)
+            continue;
+
+         m_samples.Medians[side][i][m_samples.Rounds[side][i]++] =
+            Stats::Median(m_samples.RoundSamples[i], m_samples.RoundCount[i]);
+      }
+   }
+
+   void Collect(const char* address)
+   {
+      m_samples.Count = 0;
+      const int rounds = (std::max)(2, (std::min)(m_options.Rounds, int(kMaxRepetitions)));
+      for (int round = 0; round < rounds; ++round)
+      {
+         // Alternate the order so neither binary always runs on a warmer machine
+         Sample(round % 2, address);
+         Sample(1 - round % 2, address);
+
+         if (m_samples.Count == 0)
+            return; // not a benchmark case
+      }
+   }
+
+   // Paired difference of the benchmark, false if it was not measured on both sides every round
+   bool Pair(int index, AbResult& result)
+   {
+      const int count = m_samples.Rounds[0][index];
+      if (count < 2 || count != m_samples.Rounds[1][index])
+         return false;
+
+      const double* samplesA = m_samples.Medians[0][index];
+      const double* samplesB = m_samples.Medians[1][index];
+
+      double changes[kMaxRepetitions];
+      for (int i = 0; i < count; ++i)
+      {
+         if (samplesA[i] <= 0)
+            return false;
+         changes[i] = (samplesB[i] - samplesA[i]) / samplesA[i];
+      }
+
+      const double mean = Stats::Mean(changes, count);
+      const double halfWidth = StudentT975(count - 1) * Stats::StdDev(changes, count)
+         / std::sqrt(static_cast<double>(count));
+
+      result.Address = m_samples.Addresses[index].CData();
+      result.Rounds = count;
+      result.MedianA = Stats::Median(samplesA, count);
+      result.MedianB = Stats::Median(samplesB, count);
+      result.MeanChange = mean;
+      result.ChangeLow = mean - halfWidth;
+      result.ChangeHigh = mean + halfWidth;
+      return true;
+   }
+
+   const char* m_binaryA;
+   const char* m_binaryB;
+   AbOptions   m_options;
+   Catalog     m_catalogA;
+   Catalog     m_catalogB;
+   CaseSamples m_samples;
+};
+
+// Argument values of parameter sweep, geometric (8, 64, 512, ...) or linear (1, 2, 3, ...). The
+// upper bound is always included.
+struct Range
+{
+   static Range Geometric(Count_t from, Count_t to, Count_t multiplier = 8)
+   {
+      Range range;
+      for (Count_t value = (std::max)(Count_t(1), from);
+         value < to && range.m_count < kMaxSweepPoints - 1;
+         value *= (std::max)(Count_t(2), multiplier))
+      {
+         range.Add(value);
+      }
+      range.Add(to);
+      return range;
+   }
+
+   static Range Linear(Count_t from, Count_t to, Count_t step = 1)
+   {
+      Range range;
+      for (Count_t value = from;
+         value < to && range.m_count < kMaxSweepPoints - 1;
+         value += (std::max)(Count_t(1), step))
+      {
+         range.Add(value);
+      }
+      range.Add(to);
+      return range;
+   }
+
+   int     Count() const      { return m_count; }
+   Count_t At(int index) const { return m_values[index]; }
+
+private:
+   Range() : m_count(0) {}
+
+   void Add(Count_t value)
+   {
+      if (m_count == 0 || m_values[m_count - 1] != value)
+         m_values[m_count++] = value;
+   }
+
+   Count_t m_values[kMaxSweepPoints];
+   int     m_count;
+};
+
+// Results of parameter sweep: median time for every argument value and complexity fit
+struct SweepResult
+{
+   int           Count;
+   Count_t       Args[kMaxSweepPoints];
+   double        MedianNs[kMaxSweepPoints];
+   ComplexityFit Fit;
+};
+
+// Runs the benchmark body for every argument in the range, the body gets the value with
+// State::Arg(). Every argument is reported as benchmark 'group:case/arg', then the results are
+// fitted to common complexity classes:
+//
+//    const auto sweep = tested::bench::Sweep(runtime, tested::bench::Range::Geometric(8, 16 << 20),
+//       [](tested::bench::State& state) { ... state.Arg() ... });
+//    tested::bench::ExpectComplexity(sweep, tested::bench::Complexity_ONLogN);
+//
+template <typename BodyT>
+inline SweepResult Sweep(IRuntime* runtime, const Range& range, BodyT body,
+   const Options& options = Options())
+{
+   (void)runtime;
+
+   Options effective = options;
+   Session* session = Session::Current();
+   if (session != nullptr && session->GetSettings().Repetitions > 0)
+      effective.Repetitions = session->GetSettings().Repetitions;
+
+   SweepResult sweep;
+   sweep.Count = range.Count();
+   for (int i = 0; i < range.Count(); ++i)
+   {
+      Result result;
+      result.HasArg = true;
+      result.Arg = range.At(i);
+      MeasureAndReport(body, effective, result);
+
+      sweep.Args[i] = result.Arg;
+      sweep.MedianNs[i] = result.MedianNs();
+   }
+
+   sweep.Fit = ComplexityFit::Fit(sweep.Args, sweep.MedianNs, sweep.Count);
+   if (session != nullptr)
+      session->ReportComplexity(sweep.Fit);
+   else
+      Session::PrintComplexity("<no bench::Session>", sweep.Fit);
+
+   return sweep;
+}
+
+// Fails the case when the sweep is fitted to a complexity class worse than expected
+inline void ExpectComplexity(const SweepResult& sweep, Complexity_t maxComplexity)
+{
+   if (sweep.Fit.BestFit <= maxComplexity)
+      return;
+
+   StringStorage<256> message;
+   snprintf(message.Data(), message.MaxSize(),
+      "Expected %s at most, but best fit is %s (rms %.1f%%, %s rms %.1f%%)",
+      ComplexityName(maxComplexity),
+      ComplexityName(sweep.Fit.BestFit),
+      sweep.Fit.Rms * 100,
+      ComplexityName(maxComplexity),
+      sweep.Fit.RmsOf[maxComplexity] * 100);
+   Fail(message.CData());
+}
+
+// The state passed to every thread of scaling benchmark. Threads run the body until the time is
+// over, counting the operations with KeepRunning():
+//
+//    while (state.KeepRunning())
+//       queue.Push(state.ThreadIndex());
+//
+struct alignas(64) ThreadState
+{
+   bool KeepRunning()
+   {
+      if (m_stop->load(std::memory_order_relaxed))
+         return false;
+      ++m_ops;
+      return true;
+   }
+
+   // Account the extra operations when single pass of the loop does a batch
+   void AddOps(Count_t ops) { m_ops += ops - 1; }
+
+   int     ThreadIndex() const { return m_index; }
+   int     ThreadCount() const { return m_count; }
+   Count_t Ops() const { return m_ops; }
+
+   // Private API used by bench::Scaling()
+   void Reset(int index, int count, const std::atomic<bool>* stop)
+   {
+      m_index = index;
+      m_count = count;
+      m_stop = stop;
+      m_ops = 0;
+      m_cpuNs = 0;
+   }
+
+   void SetCpuNs(double cpuNs) { m_cpuNs = cpuNs; }
+   double CpuNs() const { return m_cpuNs; }
+
+private:
+   const std::atomic<bool>* m_stop;
+   Count_t m_ops;
+   double  m_cpuNs;
+   int     m_index;
+   int     m_count;
+};
+
+// Thread counts and duration of scaling benchmark
+struct ThreadOptions
+{
+   int    ThreadCounts[32];
+   int    ThreadCountsSize;
+   int    Repetitions;    // samples for every thread count
+   double DurationMs;     // duration of one sample
+   bool   PinThreads;     // pin thread i to cpu i (Linux only, ignored elsewhere)
+
+   // 1, 2, 4, ... up to maxThreads, which is the number of hardware threads by default
+   static ThreadOptions PowersOfTwo(int maxThreads = 0)
+   {
+      if (maxThreads <= 0)
+         maxThreads = (std::max)(1, static_cast<int>(std::thread::hardware_concurrency()));
+      maxThreads = (std::min)(maxThreads, static_cast<int>(kMaxThreads));
+
+      ThreadOptions options;
+      for (int threads = 1; threads < maxThreads; threads *= 2)
+         options.Add(threads);
+      options.Add(maxThreads);
+      return options;
+   }
+
+   ThreadOptions() : ThreadCountsSize(0), Repetitions(3), DurationMs(100), PinThreads(false) {}
+
+   ThreadOptions& Add(int threads)
+   {
+      threads = (std::max)(1, (std::min)(threads, static_cast<int>(kMaxThreads)));
+      if (ThreadCountsSize < 32
+         && (ThreadCountsSize == 0 || ThreadCounts[ThreadCountsSize - 1] != threads))
+      {
+         ThreadCounts[ThreadCountsSize++] = threads;
+      }
+      return *this;
+   }
+};
+
+// Throughput of one thread count
+struct ScalingPoint
+{
+   int    Threads;
+   double OpsPerSec;   // aggregate over all threads, median of repetitions
+   double Efficiency;  // OpsPerSec relative to linear scaling of the smallest thread count
+   double Fairness;    // Jain's index of per-thread operations: 1 is perfectly fair, 1/n worst
+   double MinShare;    // smallest per-thread share of operations relative to the fair share
+};
+
+struct ScalingResult
+{
+   int          Count;
+   ScalingPoint Points[32];
+};
+
+// Runs the body on the threads of the thread pool for one sample
+struct ScalingRun
+{
+   static void Pin(std::thread& thread, int index)
+   {
+#if defined(__linux__)
+      const int cpus = (std::max)(1, static_cast<int>(std::thread::hardware_concurrency()));
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(index % cpus, &set);
+      pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+      (void)thread;
+      (void)index;
+#endif
+   }
+
+   // Returns the elapsed time, per-thread results are in states
+   template <typename BodyT>
+   static double Run(BodyT& body, int threadCount, const ThreadOptions& options,
+      ThreadState* states)
+   {
+      // Only the measuring thread is pinned by --pin-cpu, the threads it creates are not
+      const Session* session = Session::Current();
+      const Environment* environment = session != nullptr ? &session->GetEnvironment() : nullptr;
+
+      std::atomic<bool> stop(false);
+      std::atomic<int>  ready(0);
+      std::atomic<bool> go(false);
+
+      std::thread threads[kMaxThreads];
+      for (int i = 0; i < threadCount; ++i)
+      {
+         states[i].Reset(i, threadCount, &stop);
+         threads[i] = std::thread([&, i]
+         {
+            if (environment != nullptr && !options.PinThreads)
+               environment->Unpin();
+
+            // Start barrier: nobody runs the body until all threads are created
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire))
+               std::this_thread::yield();
+
+            const double cpuStart = Clock::CpuNs();
+            body(states[i]);
+            states[i].SetCpuNs(Clock::CpuNs() - cpuStart);
+         });
+
+         if (options.PinThreads)
+            Pin(threads[i], i);
+      }
+
+      while (ready.load() != threadCount)
+         std::this_thread::yield();
+
+      const double start = Clock::RealNs();
+      go.store(true, std::memory_order_release);
+      SleepMeter::SleepUncounted(std::chrono::duration<double, std::milli>(options.DurationMs));
+      stop.store(true);
+
+      for (int i = 0; i < threadCount; ++i)
+         threads[i].join();
+
+      return Clock::RealNs() - start;
+   }
+};
+
+// Multi-threaded scaling benchmark: runs the body on every thread count of the options and
+// reports the aggregate throughput, fairness and scaling efficiency. Every thread count is
+// reported as benchmark 'group:case/threads:N' with ns per operation, so it can be baselined.
+//
+//    tested::bench::Scaling(runtime, tested::bench::ThreadOptions::PowersOfTwo(),
+//       [&](tested::bench::ThreadState& state) { while (state.KeepRunning()) ...; });
+//
+template <typename BodyT>
+inline ScalingResult Scaling(IRuntime* runtime, const ThreadOptions& options, BodyT body)
+{
+   (void)runtime;
+
+   Session* session = Session::Current();
+   int repetitions = (std::max)(1, (std::min)(options.Repetitions, int(kMaxRepetitions)));
+   if (session != nullptr && session->GetSettings().Repetitions > 0)
+      repetitions = (std::min)(session->GetSettings().Repetitions, int(kMaxRepetitions));
+
+   static ThreadState s_states[kMaxThreads];
+
+   ScalingResult scaling;
+   scaling.Count = 0;
+   double baseOpsPerThread = 0;
+   for (int t = 0; t < options.ThreadCountsSize; ++t)
+   {
+      const int threadCount = options.ThreadCounts[t];
+
+      Result result;
+      result.HasArg = true;
+      result.ArgName = "threads";
+      result.Arg = threadCount;
+      result.Repetitions = repetitions;
+
+      double opsPerSec[kMaxRepetitions], fairness[kMaxRepetitions], minShare[kMaxRepetitions];
+      for (int r = 0; r < repetitions; ++r)
+      {
+         const double elapsedNs = ScalingRun::Run(body, threadCount, options, s_states);
+
+         double sum = 0, sumSquares = 0, cpuNs = 0;
+         double minOps = static_cast<double>(s_states[0].Ops());
+         for (int i = 0; i < threadCount; ++i)
+         {
+            const double ops = static_cast<double>(s_states[i].Ops());
+            sum += ops;
+            sumSquares += ops * ops;
+            cpuNs += s_states[i].CpuNs();
+            minOps = (std::min)(minOps, ops);
+         }
+
+         const double ops = (std::max)(1.0, sum);
+         opsPerSec[r] = ops * 1e9 / elapsedNs;
+         fairness[r] = sumSquares > 0 ? sum * sum / (threadCount * sumSquares) : 1;
+         minShare[r] = sum > 0 ? minOps * threadCount / sum : 1;
+         result.RealNs[r] = elapsedNs / ops;
+         result.CpuNs[r] = cpuNs / ops;
+         result.Iterations += static_cast<Count_t>(sum / repetitions);
+      }
+
+      ScalingPoint& point = scaling.Points[scaling.Count++];
+      point.Threads = threadCount;
+      point.OpsPerSec = Stats::Median(opsPerSec, repetitions);
+      point.Fairness = Stats::Median(fairness, repetitions);
+      point.MinShare = Stats::Median(minShare, repetitions);
+
+      if (t == 0)
+         baseOpsPerThread = point.OpsPerSec / threadCount;
+      point.Efficiency = baseOpsPerThread > 0 ?
+         point.OpsPerSec / (baseOpsPerThread * threadCount) : 0;
+
+      result.CounterCount = 3;
+      result.Counters[0] = Counter{ "ops_per_sec", point.OpsPerSec };
+      result.Counters[1] = Counter{ "fairness", point.Fairness };
+      result.Counters[2] = Counter{ "efficiency", point.Efficiency };
+      Report(result);
+   }
+
+   if (session == nullptr || !session->GetSettings().Quiet)
+   {
+      printf("   threads   ops/sec      efficiency  fairness  min share\n");
+      for (int i = 0; i < scaling.Count; ++i)
+      {
+         const ScalingPoint& point = scaling.Points[i];
+         printf("   %7d   %-11.4g  %9.1f%%  %8.3f  %8.1f%%\n",
+            point.Threads, point.OpsPerSec, point.Efficiency * 100, point.Fairness,
+            point.MinShare * 100);
+      }
+   }
+
+   return scaling;
+}
+
+// Log-bucketed histogram in the style of HdrHistogram. Values below 2^kSubBits are exact, above
+// that every power of two is split into 2^(kSubBits-1) linear sub-buckets, so the relative error
+// is below 1/2^(kSubBits-1) (~1.6%) over the whole range of uint64 nanoseconds up to 2^kMaxBits.
+struct Histogram
+{
+   enum
+   {
+      kSubBits     = 7,
+      kHalf        = 1 << (kSubBits - 1),
+      kMaxBits     = 48,
+      kBucketCount = (1 << kSubBits) + (kMaxBits - kSubBits) * kHalf
+   };
+
+   Histogram() { Clear(); }
+
+   void Clear()
+   {
+      std::fill_n(m_counts, int(kBucketCount), uint64_t(0));
+      m_total = 0;
+      m_max = 0;
+      m_sum = 0;
+   }
+
+   void Record(uint64_t value, uint64_t count = 1)
+   {
+      m_counts[Index(value)] += count;
+      m_total += count;
+      m_max = (std::max)(m_max, value);
+      m_sum += static_cast<double>(value) * count;
+   }
+
+   uint64_t TotalCount() const { return m_total; }
+   uint64_t Max() const { return m_max; }
+   double   Mean() const { return m_total > 0 ? m_sum / m_total : 0; }
+
+   // Value at percentile in [0..1], it is the highest value equivalent to the bucket
+   uint64_t Percentile(double percentile) const
+   {
+      if (m_total == 0)
+         return 0;
+
+      const double rank = (std::max)(1.0, std::ceil(percentile * m_total));
+      uint64_t seen = 0;
+      for (int i = 0; i < kBucketCount; ++i)
+      {
+         seen += m_counts[i];
+         if (seen >= rank)
+            return (std::min)(HighestEquivalent(i), m_max);
+      }
+      return m_max;
+   }
+
+   // Percentile distribution in the HdrHistogram text format (.hgrm) for plotting tools
+   void Export(FILE* file) const
+   {
+      fprintf(file, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount",
+         "1/(1-Percentile)");
+
+      uint64_t seen = 0;
+      for (int i = 0; i < kBucketCount; ++i)
+      {
+         if (m_counts[i] == 0)
+            continue;
+
+         seen += m_counts[i];
+         const double percentile = static_cast<double>(seen) / m_total;
+         if (seen < m_total)
+            fprintf(file, "%12.3f %14.12f %10llu %14.2f\n",
+               static_cast<double>(HighestEquivalent(i)) / 1000, percentile,
+               static_cast<unsigned long long>(seen), 1 / (1 - percentile));
+         else
+            fprintf(file, "%12.3f %14.12f %10llu %14s\n",
+               static_cast<double>(m_max) / 1000, 1.0,
+               static_cast<unsigned long long>(seen), "inf");
+      }
+
+      fprintf(file, "#[Mean = %12.3f, Max = %12.3f, Total count = %12llu]\n",
+         Mean() / 1000, static_cast<double>(m_max) / 1000,
+         static_cast<unsigned long long>(m_total));
+   }
+
+   static int Index(uint64_t value)
+   {
+      if (value < (uint64_t(1) << kSubBits))
+         return static_cast<int>(value);
+
+      int msb = 0;
+      for (uint64_t v = value; v > 1; v >>= 1)
+         ++msb;
+      if (msb >= kMaxBits)
+         return kBucketCount - 1;
+
+      const int shift = msb - (kSubBits - 1);
+      return (1 << kSubBits) + (msb - kSubBits) * kHalf
+         + static_cast<int>((value >> shift) - kHalf);
+   }
+
+   static uint64_t HighestEquivalent(int index)
+   {
+      if (index < (1 << kSubBits))
+         return static_cast<uint64_t>(index);
+
+      const int offset = index - (1 << kSubBits);
+      const int msb = offset / kHalf + kSubBits;
+      const int shift = msb - (kSubBits - 1);
+      const uint64_t lowest = static_cast<uint64_t>(offset % kHalf + kHalf) << shift;
+      return lowest + (uint64_t(1) << shift) - 1;
+   }
+
+private:
+   uint64_t m_counts[kBucketCount];
+   uint64_t m_total;
+   uint64_t m_max;
+   double   m_sum;
+};
+
+// Open-loop latency benchmark configuration
+struct LatencyOptions
+{
+   double      RatePerSec;  // operations are scheduled at this constant rate
+   double      DurationMs;  // duration of the measured schedule
+   double      WarmupMs;    // schedule run before the measurement, not recorded
+   const char* ExportPath;  // write the corrected histogram (.hgrm format) here if not null
+
+   LatencyOptions() : RatePerSec(10000), DurationMs(1000), WarmupMs(100), ExportPath(nullptr) {}
+};
+
+// Latency distributions of the open-loop benchmark. Response time is measured from the moment
+// when operation was scheduled to start, so the delay of operations queued behind a slow one is
+// accounted (coordinated omission correction). Service time is measured from the actual start,
+// which is what a closed-loop benchmark sees.
+struct LatencyResult
+{
+   Count_t   Operations;
+   double    AchievedRatePerSec;
+   Histogram Response;
+   Histogram Service;
+};
+
+// Issues the operations at the target rate and records per-operation latency:
+//
+//    tested::bench::LatencyOptions options;
+//    options.RatePerSec = 50000;
+//    tested::bench::Latency(runtime, options, [&] { cache.Get(key); });
+//
+// Reported as benchmark with p50 of response time and cpu time of the operation, and counters 
+// with p99, p99.9, max and the service time.
+template <typename OperationT>
+inline void Latency(IRuntime* runtime, const LatencyOptions& options, OperationT operation,
+   LatencyResult* out = nullptr)
+{
+   (void)runtime;
+
+   static LatencyResult s_result;
+   LatencyResult& res = out != nullptr ? *out : s_result;
+   res.Response.Clear();
+   res.Service.Clear();
+
+   const double intervalNs = 1e9 / (std::max)(1e-3, options.RatePerSec);
+   const double warmupNs = options.WarmupMs * 1e6;
+   const double endNs = warmupNs + options.DurationMs * 1e6;
+
+   const double startNs = Clock::RealNs();
+   Count_t scheduled = 0;
+   Count_t recorded = 0;
+   double lastDoneNs = startNs;
+   double cpuNs = 0;
+
+   // Reading the thread cpu clock is a system call on many platforms, its cost is subtracted
+   double cpuReadNs = 0;
+   for (int i = 0; i < 64; ++i)
+   {
+      const double beforeNs = Clock::CpuNs();
+      cpuReadNs += Clock::CpuNs() - beforeNs;
+   }
+   cpuReadNs /= 64;
+   while (true)
+   {
+      const double intendedNs = startNs + scheduled * intervalNs;
+      if (intendedNs - startNs >= endNs)
+         break;
+
+      // Wait for the schedule spinning, the sleep is only used for low rates because late wake
+      // up of the issuer is accounted as latency of the operation
+      double now = Clock::RealNs();
+      while (now < intendedNs)
+      {
+         if (intendedNs - now > 2e6)
+            SleepMeter::SleepUncounted(std::chrono::microseconds(500));
+         now = Clock::RealNs();
+      }
+
+      // The service time starts after the cpu clock is read
+      const double cpuBeforeNs = Clock::CpuNs();
+      now = Clock::RealNs();
+      operation();
+      lastDoneNs = Clock::RealNs();
+      const double cpuAfterNs = Clock::CpuNs();
+      ++scheduled;
+
+      if (intendedNs - startNs < warmupNs)
+         continue;
+
+      cpuNs += (std::max)(0.0, cpuAfterNs - cpuBeforeNs - cpuReadNs);
+      res.Response.Record(static_cast<uint64_t>(lastDoneNs - intendedNs));
+      res.Service.Record(static_cast<uint64_t>(lastDoneNs - now));
+      ++recorded;
+   }
+
+   res.Operations = recorded;
+   const double measuredNs = lastDoneNs - startNs - warmupNs;
+   res.AchievedRatePerSec = measuredNs > 0 ? recorded * 1e9 / measuredNs : 0;
+
+   if (options.ExportPath != nullptr)
+   {
+      FILE* file = fopen(options.ExportPath, "w");
+      if (file == nullptr)
+         Fail("Cannot write latency histogram");
+      res.Response.Export(file);
+      fclose(file);
+   }
+
+   Result result;
+   result.Iterations = recorded;
+   result.Repetitions = 1;
+   result.RealNs[0] = static_cast<double>(res.Response.Percentile(0.5));
+   result.CpuNs[0] = recorded > 0 ? cpuNs / recorded : 0;
+   result.CounterCount = 7;
+   result.Counters[0] = Counter{ "p99_ns", double(res.Response.Percentile(0.99)) };
+   result.Counters[1] = Counter{ "p999_ns", double(res.Response.Percentile(0.999)) };
+   result.Counters[2] = Counter{ "max_ns", double(res.Response.Max()) };
+   result.Counters[3] = Counter{ "service_p50_ns", double(res.Service.Percentile(0.5)) };
+   result.Counters[4] = Counter{ "service_p99_ns", double(res.Service.Percentile(0.99)) };
+   result.Counters[5] = Counter{ "target_rate", options.RatePerSec };
+   result.Counters[6] = Counter{ "achieved_rate", res.AchievedRatePerSec };
+   Report(result);
+}
+
+// Writes the benchmark results in Google Benchmark JSON format (--benchmark_format=json), so the
+// tools made for it (compare.py, dashboards) can read the results of tested benchmarks. The case
+// address is the benchmark name:
+//
+//    tested::bench::JsonObserver json("results.json", argv[0]);
+//    tested::bench::Session session(settings, nullptr, &json);
+//
+// Every repetition is written as "iteration" run, followed by mean, median and stddev
+// aggregates. Complexity fits of sweeps are written as BigO and RMS aggregates.
+struct JsonObserver final: IObserver
+{
+   JsonObserver(const char* path, const char* executable = "")
+      : m_file(fopen(path, "w")), m_ownsFile(true), m_executable(executable)
+   {
+      Init();
+   }
+
+   JsonObserver(FILE* file, const char* executable = "")
+      : m_file(file), m_ownsFile(false), m_executable(executable)
+   {
+      Init();
+   }
+
+   ~JsonObserver() { Close(); }
+
+   bool IsOpen() const { return m_file != nullptr; }
+
+   void OnBenchmark(const Result& result) override
+   {
+      if (m_file == nullptr)
+         return;
+
+      WriteHeader();
+      NextFamily(result.Address);
+
+      const int threads = IsThreads(result) ? static_cast<int>(result.Arg) : 1;
+      for (int i = 0; i < result.Repetitions; ++i)
+      {
+         BeginEntry(result.Address, result.Address, "iteration", result.Repetitions, threads);
+         fprintf(m_file, ",\n      \"repetition_index\": %d", i);
+         fprintf(m_file, ",\n      \"iterations\": %lld", static_cast<long long>(result.Iterations));
+         WriteTimes(result.RealNs[i], result.CpuNs[i]);
+         WriteCounters(result);
+         EndEntry();
+      }
+
+      if (result.Repetitions < 2)
+         return;
+
+      static const char* const kAggregates[] = { "mean", "median", "stddev" };
+      for (int a = 0; a < 3; ++a)
+      {
+         StringStorage<kMaxAddress + 16> name;
+         snprintf(name.Data(), name.MaxSize(), "%s_%s", result.Address, kAggregates[a]);
+
+         BeginEntry(name.CData(), result.Address, "aggregate", result.Repetitions, threads);
+         fprintf(m_file, ",\n      \"aggregate_name\": \"%s\"", kAggregates[a]);
+         fprintf(m_file, ",\n      \"aggregate_unit\": \"time\"");
+         fprintf(m_file, ",\n      \"iterations\": %d", result.Repetitions);
+         WriteTimes(Aggregate(a, result.RealNs, result.Repetitions),
+            Aggregate(a, result.CpuNs, result.Repetitions));
+         WriteCounters(result);
+         EndEntry();
+      }
+   }
+
+   void OnComplexity(const char* address, const ComplexityFit& fit) override
+   {
+      if (m_file == nullptr)
+         return;
+
+      static const char* const kBigO[] = { "(1)", "lgN", "N", "NlgN", "N^2" };
+
+      WriteHeader();
+      StringStorage<kMaxAddress + 16> name;
+      snprintf(name.Data(), name.MaxSize(), "%s_BigO", address);
+      BeginEntry(name.CData(), address, "aggregate", 1, 1);
+      fprintf(m_file, ",\n      \"aggregate_name\": \"BigO\"");
+      fprintf(m_file, ",\n      \"aggregate_unit\": \"time\"");
+      fprintf(m_file, ",\n      \"cpu_coefficient\": %.17g", fit.Coefficient);
+      fprintf(m_file, ",\n      \"real_coefficient\": %.17g", fit.Coefficient);
+      fprintf(m_file, ",\n      \"big_o\": \"%s\"",
+         fit.BestFit < Complexity_Count ? kBigO[fit.BestFit] : "f(N)");
+      fprintf(m_file, ",\n      \"time_unit\": \"ns\"");
+      EndEntry();
+
+      snprintf(name.Data(), name.MaxSize(), "%s_RMS", address);
+      BeginEntry(name.CData(), address, "aggregate", 1, 1);
+      fprintf(m_file, ",\n      \"aggregate_name\": \"RMS\"");
+      fprintf(m_file, ",\n      \"aggregate_unit\": \"percentage\"");
+      fprintf(m_file, ",\n      \"rms\": %.17g", fit.Rms);
+      EndEntry();
+   }
+
+   void OnDone() override { Close(); }
+
+private:
+   void Init()
+   {
+      m_headerWritten = false;
+      m_entries = 0;
+      m_familyIndex = -1;
+      m_familyInstance = 0;
+   }
+
+   void Close()
+   {
+      if (m_file == nullptr)
+         return;
+
+      WriteHeader();
+      fprintf(m_file, "\n  ]\n}\n");
+      if (m_ownsFile)
+         fclose(m_file);
+      else
+         fflush(m_file);
+      m_file = nullptr;
+   }
+
+   static bool IsThreads(const Result& result)
+   {
+      return result.HasArg && result.ArgName != nullptr && strcmp(result.ArgName, "threads") == 0;
+   }
+
+   static double Aggregate(int aggregate, const double* values, int count)
+   {
+      switch (aggregate)
+      {
+      case 0:  return Stats::Mean(values, count);
+      case 1:  return Stats::Median(values, count);
+      default: return Stats::StdDev(values, count);
+      }
+   }
+
+   void WriteString(const char* value)
+   {
+      fputc('"', m_file);
+      for (const char* c = value; *c != 0; ++c)
+      {
+         if (*c == '"' || *c == '\\')
+            fprintf(m_file, "\\%c", *c);
+         else if (static_cast<unsigned char>(*c) < 0x20)
+            fprintf(m_file, "\\u%04x", static_cast<unsigned char>(*c));
+         else
+            fputc(*c, m_file);
+      }
+      fputc('"', m_file);
+   }
+
+   void WriteHeader()
+   {
+      if (m_headerWritten || m_file == nullptr)
+         return;
+      m_headerWritten = true;
+
+      const Session* session = Session::Current();
+      const Environment env = session != nullptr && session->GetSettings().CheckEnvironment ?
+         session->GetEnvironment() : Environment::Detect();
+
+      char date[64] = "";
+      const time_t now = time(nullptr);
+      const tm* local = localtime(&now);
+      if (local != nullptr)
+         strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", local);
+
+      char host[256] = "";
+#if defined(__unix__) || defined(__APPLE__)
+      gethostname(host, sizeof(host) - 1);
+#endif
+
+      fprintf(m_file, "{\n  \"context\": {\n");
+      fprintf(m_file, "    \"date\": \"%s\",\n", date);
+      fprintf(m_file, "    \"host_name\": ");
+      WriteString(host);
+      fprintf(m_file, ",\n    \"executable\": ");
+      WriteString(m_executable != nullptr ? m_executable : "");
+      fprintf(m_file, ",\n    \"num_cpus\": %d,\n", env.CpuCount);
+      fprintf(m_file, "    \"mhz_per_cpu\": %d,\n", CpuMhz());
+      fprintf(m_file, "    \"cpu_scaling_enabled\": %s,\n",
+         !env.Governor.Empty() && strcmp(env.Governor.CData(), "performance") != 0 ?
+            "true" : "false");
+      fprintf(m_file, "    \"caches\": [");
+      WriteCaches();
+      fprintf(m_file, "],\n");
+      if (env.LoadAverage >= 0)
+         fprintf(m_file, "    \"load_avg\": [%g],\n", env.LoadAverage);
+      fprintf(m_file, "    \"noise\": %g,\n", env.Noise);
+#if defined(NDEBUG)
+      fprintf(m_file, "    \"library_build_type\": \"release\"\n");
+#else
+      fprintf(m_file, "    \"library_build_type\": \"debug\"\n");
+#endif
+      fprintf(m_file, "  },\n  \"benchmarks\": [");
+   }
+
+   static int CpuMhz()
+   {
+      double mhz = 0;
+#if defined(__linux__)
+      FILE* file = fopen("/proc/cpuinfo", "r");
+      if (file == nullptr)
+         return 0;
+
+      char line[256];
+      while (mhz == 0 && fgets(line, sizeof(line), file) != nullptr)
+         if (strncmp(line, "cpu MHz", 7) == 0 && strchr(line, ':') != nullptr)
+            mhz = atof(strchr(line, ':') + 1);
+      fclose(file);
+#endif
+      return static_cast<int>(mhz);
+   }
+
+   void WriteCaches()
+   {
+#if defined(__linux__)
+      int written = 0;
+      for (int index = 0; index < 8; ++index)
+      {
+         char path[96], type[32] = "";
+         int level = 0;
+
+         snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+         FILE* file = fopen(path, "r");
+         if (file == nullptr)
+            continue;
+         const bool hasLevel = fscanf(file, "%d", &level) == 1;
+         fclose(file);
+
+         snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+         if ((file = fopen(path, "r")) != nullptr)
+         {
+            if (fscanf(file, "%31s", type) != 1)
+               type[0] = 0;
+            fclose(file);
+         }
+
+         snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+         long bytes = 0;
+         if ((file = fopen(path, "r")) != nullptr)
+         {
+            char unit = 0;
+            if (fscanf(file, "%ld%c", &bytes, &unit) >= 1)
+               bytes = unit == 'M' ? bytes << 20 : (unit == 'K' ? bytes << 10 : bytes);
+            fclose(file);
+         }
+
+         if (!hasLevel)
+            continue;
+
+         fprintf(m_file, "%s\n      {\"type\": \"%s\", \"level\": %d, \"size\": %ld, "
+            "\"num_sharing\": 0}", written++ > 0 ? "," : "", type, level, bytes);
+      }
+      if (written > 0)
+         fprintf(m_file, "\n    ");
+#endif
+   }
+
+   // Family is the case, instances are its arguments or variants
+   void NextFamily(const char* address)
+   {
+      const char* colon = strchr(address, ':');
+      const char* slash = strchr(colon != nullptr ? colon : address, '/');
+      const size_t len = slash != nullptr ? static_cast<size_t>(slash - address) : strlen(address);
+
+      if (m_familyIndex >= 0 && m_family.CData() == std::string_view(address, len))
+      {
+         ++m_familyInstance;
+         return;
+      }
+
+      m_family.Assign(std::string_view(address, len));
+      ++m_familyIndex;
+      m_familyInstance = 0;
+   }
+
+   void BeginEntry(const char* name, const char* runName, const char* runType,
+      int repetitions, int threads)
+   {
+      fprintf(m_file, "%s\n    {\n      \"name\": ", m_entries++ > 0 ? "," : "");
+      WriteString(name);
+      fprintf(m_file, ",\n      \"family_index\": %d", (std::max)(0, m_familyIndex));
+      fprintf(m_file, ",\n      \"per_family_instance_index\": %d", m_familyInstance);
+      fprintf(m_file, ",\n      \"run_name\": ");
+      WriteString(runName);
+      fprintf(m_file, ",\n      \"run_type\": \"%s\"", runType);
+      fprintf(m_file, ",\n      \"repetitions\": %d", repetitions);
+      fprintf(m_file, ",\n      \"threads\": %d", threads);
+   }
+
+   void WriteTimes(double realNs, double cpuNs)
+   {
+      fprintf(m_file, ",\n      \"real_time\": %.17g", realNs);
+      fprintf(m_file, ",\n      \"cpu_time\": %.17g", cpuNs);
+      fprintf(m_file, ",\n      \"time_unit\": \"ns\"");
+   }
+
+   void WriteCounters(const Result& result)
+   {
+      for (int i = 0; i < result.CounterCount; ++i)
+      {
+         fprintf(m_file, ",\n      ");
+         WriteString(result.Counters[i].Name);
+         fprintf(m_file, ": %.17g", result.Counters[i].Value);
+      }
+   }
+
+   void EndEntry() { fprintf(m_file, "\n    }"); }
+
+   FILE*       m_file;
+   bool        m_ownsFile;
+   const char* m_executable;
+   bool        m_headerWritten;
+   int         m_entries;
+   int         m_familyIndex;
+   int         m_familyInstance;
+   StringStorage<kMaxAddress> m_family;
+};
+
+// Timing assertions for the ordinary test cases, e.g. that the call completes under 50us at p99
+// or it is at most 2x slower than memcpy on the same machine. The measured code runs in batches
+// big enough for the timer resolution, the failure message has the measured distribution.
+// A sample is the mean call time of one batch, so with more than one call per batch the 
+// percentiles are of the batch means and a slow call is averaged with the rest of its batch.
+//
+//    tested::bench::ExpectPercentileUnder([&] { parser.Parse(input); }, 0.99, 50000);
+//    tested::bench::ExpectRelative([&] { codec.Encode(buf); },
+//       tested::bench::MemcpyKernel(64 * 1024), 2.0);
+//
+struct TimingOptions
+{
+   int    Samples;       // number of timed batches
+   double MinBatchNs;    // calls are batched until one batch takes this long
+   double MaxTimeMs;     // time budget, less samples are taken when it is over
+   double ReferenceNs;   // ReferenceKernelNs() on the machine where the limits were set
+
+   TimingOptions() : Samples(1000), MinBatchNs(1000), MaxTimeMs(500), ReferenceNs(0) {}
+};
+
+// Distribution of per call times, each sample is the mean of one batch of calls
+struct Timing
+{
+   enum { kMaxSamples = 1024 };
+
+   int     Count;
+   Count_t Batch;        // calls per sample
+   double  SamplesNs[kMaxSamples];  // sorted
+
+   double Percentile(double percentile) const
+   {
+      if (Count <= 0)
+         return 0;
+      const double pos = percentile * (Count - 1);
+      const int lo = static_cast<int>(pos);
+      const int hi = (std::min)(lo + 1, Count - 1);
+      return SamplesNs[lo] + (SamplesNs[hi] - SamplesNs[lo]) * (pos - lo);
+   }
+
+   double Min() const    { return Count > 0 ? SamplesNs[0] : 0; }
+   double Median() const { return Percentile(0.5); }
+   double Max() const    { return Count > 0 ? SamplesNs[Count - 1] : 0; }
+
+   const char* Format(StringStorage<256>& buf) const
+   {
+      StringStorage<32> min, p50, p90, p99, max;
+      snprintf(buf.Data(), buf.MaxSize(),
+         "n=%d x %lld calls: min %s, p50 %s, p90 %s, p99 %s, max %s",
+         Count, static_cast<long long>(Batch),
+         FormatNs(Min(), min), FormatNs(Median(), p50), FormatNs(Percentile(0.9), p90),
+         FormatNs(Percentile(0.99), p99), FormatNs(Max(), max));
+      return buf.CData();
+   }
+};
+
+// Measures the distribution of the function call time
+template <typename FunctionT>
+inline void Time(FunctionT& function, const TimingOptions& options, Timing& timing)
+{
+   // Warm up (the first calls touch the memory for the first time) and find the batch size
+   for (int i = 0; i < 3; ++i)
+      function();
+
+   Count_t batch = 1;
+   while (true)
+   {
+      const double start = Clock::RealNs();
+      for (Count_t i = 0; i < batch; ++i)
+         function();
+      const double elapsed = Clock::RealNs() - start;
+      if (elapsed >= options.MinBatchNs || batch >= (Count_t(1) << 30))
+         break;
+      batch *= 2;
+   }
+
+   const int samples = (std::max)(1, (std::min)(options.Samples, int(Timing::kMaxSamples)));
+   const double deadline = Clock::RealNs() + options.MaxTimeMs * 1e6;
+
+   timing.Batch = batch;
+   timing.Count = 0;
+   while (timing.Count < samples)
+   {
+      const double start = Clock::RealNs();
+      for (Count_t i = 0; i < batch; ++i)
+         function();
+      const double end = Clock::RealNs();
+      timing.SamplesNs[timing.Count++] = (end - start) / batch;
+
+      if (end > deadline && timing.Count >= 10)
+         break;
+   }
+
+   std::sort(timing.SamplesNs, timing.SamplesNs + timing.Count);
+}
+
+// Copies the buffer, the reference kernel for relative assertions and machine normalization
+struct MemcpyKernel
+{
+   explicit MemcpyKernel(size_t bytes) : m_bytes((std::min)(bytes, size_t(kMaxBytes))) {}
+
+   void operator()() const
+   {
+      memcpy(Buffers().Destination, Buffers().Source, m_bytes);
+      DoNotOptimize(Buffers().Destination[0]);
+   }
+
+private:
+   enum { kMaxBytes = 1 << 20 };
+
+   struct Storage
+   {
+      char Source[kMaxBytes];
+      char Destination[kMaxBytes];
+   };
+
+   static Storage& Buffers()
+   {
+      static Storage s_storage;
+      return s_storage;
+   }
+
+   size_t m_bytes;
+};
+
+// Median time of the reference kernel (64KB memcpy) on this machine, measured once per process.
+// Timing limits are scaled by ReferenceKernelNs() / TimingOptions::ReferenceNs to make them
+// independent from the speed of machine.
+inline double ReferenceKernelNs()
+{
+   static const double s_referenceNs = []
+   {
+      MemcpyKernel kernel(64 * 1024);
+      TimingOptions options;
+      options.Samples = 200;
+      static Timing s_timing;
+      Time(kernel, options, s_timing);
+      return s_timing.Median();
+   }();
+   return s_referenceNs;
+}
+
+// Fails the case when the percentile of call time is over the limit. The limit is scaled to this
+// machine if TimingOptions::ReferenceNs is given. The percentile is of the batch means, it is the
+// one of single calls only when a call takes longer than TimingOptions::MinBatchNs (Batch is 1).
+template <typename FunctionT>
+inline void ExpectPercentileUnder(FunctionT function, double percentile, double limitNs,
+   const TimingOptions& options = TimingOptions())
+{
+   double scale = 1;
+   if (options.ReferenceNs > 0)
+      scale = ReferenceKernelNs() / options.ReferenceNs;
+
+   static Timing s_timing;
+   Time(function, options, s_timing);
+
+   const double measured = s_timing.Percentile(percentile);
+   if (measured <= limitNs * scale)
+      return;
+
+   StringStorage<32> measuredNs, limit;
+   StringStorage<256> distribution;
+   StringStorage<512> message;
+   snprintf(message.Data(), message.MaxSize(),
+      "p%g of the means of %lld-call batches %s is over the limit %s (scale %.2f); %s",
+      percentile * 100, static_cast<long long>(s_timing.Batch), FormatNs(measured, measuredNs),
+      FormatNs(limitNs * scale, limit), scale, s_timing.Format(distribution));
+   Fail(message.CData());
+}
+
+// Fails the case when the median call time is more than maxRatio times of the reference function
+// median time on the same machine.
+template <typename FunctionT, typename ReferenceT>
+inline void ExpectRelative(FunctionT function, ReferenceT reference, double maxRatio,
+   const TimingOptions& options = TimingOptions())
+{
+   static Timing s_timing, s_reference;
+   Time(reference, options, s_reference);
+   Time(function, options, s_timing);
+
+   const double ratio = s_reference.Median() > 0 ? s_timing.Median() / s_reference.Median() : 0;
+   if (ratio <= maxRatio)
+      return;
+
+   StringStorage<256> distribution, referenceDistribution;
+   StringStorage<768> message;
+   snprintf(message.Data(), message.MaxSize(),
+      "%.2fx of the reference time, limit is %.2fx; measured %s; reference %s",
+      ratio, maxRatio, s_timing.Format(distribution),
+      s_reference.Format(referenceDistribution));
+   Fail(message.CData());
+}
+
+} // namespace bench
+} // namespace tested
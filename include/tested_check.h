@@ -0,0 +1,853 @@
+//
+//   \|/ Tested
+//   /|\ Checks over generated inputs
+//
+//  The backend for the cases which check the code on many generated inputs instead of a few
+//  handwritten ones. The inputs are made by the deterministic PRNG from the seed and the index
+//  of the input, so the failure is reported with the seed and the input which can be replayed
+//  regardless of how the inputs were spread between the threads:
+//
+//     template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+//     {
+//        runtime->StartCase("sum");
+//        static const tested::check::Implementation<Vector, float> implementations[] =
+//        {
+//           { "scalar", SumScalar },
+//           { "sse",    SumSse },
+//        };
+//        tested::check::Differential(implementations,
+//           [](tested::check::Rng& rng, size_t) { return RandomVector(rng); });
+//     }
+//
+//  Properties are checked the same way on the values of generators, the failing value is shrunk
+//  to the minimal counterexample before it is reported:
+//
+//     tested::check::Property(tested::check::Arbitrary<std::vector<int>>(),
+//        [](const std::vector<int>& values) { return Reverse(Reverse(values)) == values; });
+//
+//  The seed is fixed by default so the runs are reproducible, TESTED_SEED environment variable
+//  sets another one and TESTED_INPUT replays only the input with the given index. Values are
+//  rendered into the failure messages with check::Show<T>, which can be specialized for the
+//  user types.
+//
+#pragma once
+
+#include "tested.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tested {
+namespace check {
+
+enum
+{
+   kMaxThreads = 64,
+   kMaxShownItems = 16,   // container elements rendered in the message
+   kMaxShownChars = 64    // string characters rendered in the message
+};
+
+// Fast deterministic PRNG (xoshiro256**), the state is expanded from the seed and the stream
+// with splitmix64, so each input index has its own independent stream
+struct Rng
+{
+   explicit Rng(uint64_t seed, uint64_t stream = 0)
+   {
+      uint64_t x = seed ^ (stream * 0x9E3779B97F4A7C15ull);
+      for (uint64_t& word : m_state)
+         word = SplitMix(x);
+   }
+
+   uint64_t Next()
+   {
+      const uint64_t result = Rotate(m_state[1] * 5, 7) * 9;
+      const uint64_t t = m_state[1] << 17;
+      m_state[2] ^= m_state[0];
+      m_state[3] ^= m_state[1];
+      m_state[1] ^= m_state[2];
+      m_state[0] ^= m_state[3];
+      m_state[2] ^= t;
+      m_state[3] = Rotate(m_state[3], 45);
+      return result;
+   }
+
+   // Uniform in [0, bound) without modulo bias
+   uint64_t Below(uint64_t bound)
+   {
+      if (bound == 0)
+         return 0;
+      const uint64_t threshold = (0 - bound) % bound;
+      while (true)
+      {
+         const uint64_t value = Next();
+         if (value >= threshold)
+            return value % bound;
+      }
+   }
+
+   // Uniform in [low, high]
+   int64_t Range(int64_t low, int64_t high)
+   {
+      const uint64_t span = static_cast<uint64_t>(high) - static_cast<uint64_t>(low);
+      const uint64_t offset = span == UINT64_MAX ? Next() : Below(span + 1);
+      return static_cast<int64_t>(static_cast<uint64_t>(low) + offset);
+   }
+
+   // Uniform in [0, 1)
+   double Unit() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+   bool Bool() { return (Next() >> 63) != 0; }
+
+private:
+   static uint64_t Rotate(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+   static uint64_t SplitMix(uint64_t& x)
+   {
+      uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      return z ^ (z >> 31);
+   }
+
+   uint64_t m_state[4];
+};
+
+// The seed of the run: TESTED_SEED environment variable (decimal or 0x hex) or the fixed one
+inline uint64_t DefaultSeed()
+{
+   const char* value = getenv("TESTED_SEED");
+   if (value != nullptr && value[0] != 0)
+      return strtoull(value, nullptr, 0);
+   return 0x7E57EDull;
+}
+
+// The single input to replay: TESTED_INPUT environment variable or -1 for all inputs
+inline int64_t DefaultOnlyInput()
+{
+   const char* value = getenv("TESTED_INPUT");
+   if (value != nullptr && value[0] != 0)
+      return strtoll(value, nullptr, 0);
+   return -1;
+}
+
+// Bounded text for the failure messages, the tail which does not fit is cut with "..."
+struct Writer
+{
+   char*  Data;
+   size_t Capacity;
+   size_t Length;
+
+   Writer(char* data, size_t capacity) : Data(data), Capacity(capacity), Length(0)
+   {
+      Data[0] = 0;
+   }
+
+   bool IsFull() const { return Length + 1 >= Capacity; }
+
+   void Printf(const char* format, ...)
+   {
+      if (IsFull())
+         return;
+
+      va_list args;
+      va_start(args, format);
+      const int written = vsnprintf(Data + Length, Capacity - Length, format, args);
+      va_end(args);
+
+      if (written < 0)
+         return;
+      Length = (std::min)(Length + static_cast<size_t>(written), Capacity - 1);
+      if (IsFull() && Capacity > 4)
+         memcpy(Data + Capacity - 4, "...", 4);
+   }
+};
+
+template <size_t SizeP>
+struct Text
+{
+   char   Buffer[SizeP];
+   Writer Out;
+
+   Text() : Out(Buffer, SizeP) {}
+   Text(const Text&) = delete;
+   Text& operator=(const Text&) = delete;
+
+   const char* CData() const { return Buffer; }
+};
+
+template <typename T, typename = void>
+struct IsContainer : std::false_type {};
+
+template <typename T>
+struct IsContainer<T, std::void_t<decltype(std::declval<const T&>().begin()),
+   decltype(std::declval<const T&>().end())>> : std::true_type {};
+
+// Renders the value into the failure message, specialize it for the user types
+template <typename T, typename Enable = void>
+struct Show
+{
+   static void Print(Writer& out, const T& value)
+   {
+      if constexpr (std::is_same_v<T, bool>)
+         out.Printf("%s", value ? "true" : "false");
+      else if constexpr (std::is_same_v<T, char>)
+         PrintChars(out, &value, 1, '\'');
+      else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+         out.Printf("%lld", static_cast<long long>(value));
+      else if constexpr (std::is_integral_v<T>)
+         out.Printf("%llu", static_cast<unsigned long long>(value));
+      else if constexpr (std::is_enum_v<T>)
+         out.Printf("%lld", static_cast<long long>(value));
+      else if constexpr (std::is_floating_point_v<T>)
+         out.Printf("%.17g", static_cast<double>(value));
+      else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+      {
+         const std::string_view text = value;
+         PrintChars(out, text.data(), text.size(), '"');
+      }
+      else if constexpr (IsContainer<T>::value)
+         PrintItems(out, value);
+      else
+         out.Printf("<%s>", TypeName<T>::Get());
+   }
+
+   static void PrintChars(Writer& out, const char* data, size_t size, char quote)
+   {
+      out.Printf("%c", quote);
+      for (size_t i = 0; i < size && i < kMaxShownChars; ++i)
+      {
+         const unsigned char c = static_cast<unsigned char>(data[i]);
+         if (c == '\n')
+            out.Printf("\\n");
+         else if (c == static_cast<unsigned char>(quote) || c == '\\')
+            out.Printf("\\%c", c);
+         else if (c < 0x20 || c >= 0x7f)
+            out.Printf("\\x%02x", c);
+         else
+            out.Printf("%c", c);
+      }
+      if (size > kMaxShownChars)
+         out.Printf("...(%zu chars)", size);
+      out.Printf("%c", quote);
+   }
+
+   static void PrintItems(Writer& out, const T& container)
+   {
+      size_t count = 0;
+      out.Printf("[");
+      for (const auto& item : container)
+      {
+         if (count < kMaxShownItems)
+         {
+            out.Printf(count == 0 ? "" : ", ");
+            Show<std::decay_t<decltype(item)>>::Print(out, item);
+         }
+         ++count;
+      }
+      if (count > kMaxShownItems)
+         out.Printf(", ...(%zu items)", count);
+      out.Printf("]");
+   }
+};
+
+template <typename FirstT, typename SecondT>
+struct Show<std::pair<FirstT, SecondT>>
+{
+   static void Print(Writer& out, const std::pair<FirstT, SecondT>& value)
+   {
+      out.Printf("(");
+      Show<FirstT>::Print(out, value.first);
+      out.Printf(", ");
+      Show<SecondT>::Print(out, value.second);
+      out.Printf(")");
+   }
+};
+
+template <typename T>
+inline void Print(Writer& out, const T& value) { Show<T>::Print(out, value); }
+
+// Default equivalence of the outputs
+struct Equal
+{
+   template <typename T>
+   bool operator()(const T& expected, const T& actual) const { return expected == actual; }
+};
+
+// Runs the function over the indices in the threads, indices are taken in small batches. The
+// function returns false to stop the run, e.g. when the failure is found.
+template <typename FunctionT>
+inline void ParallelFor(size_t count, unsigned threadCount, FunctionT function)
+{
+   if (threadCount == 0)
+      threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+   const size_t batches = (count + 15) / 16;
+   if (threadCount > kMaxThreads)
+      threadCount = kMaxThreads;
+   if (threadCount > batches)
+      threadCount = static_cast<unsigned>(batches);
+
+   std::atomic<size_t> next(0);
+   std::atomic<bool> stop(false);
+   auto worker = [&]()
+   {
+      while (!stop.load(std::memory_order_relaxed))
+      {
+         const size_t begin = next.fetch_add(16);
+         if (begin >= count)
+            return;
+         for (size_t i = begin; i < (std::min)(count, begin + 16); ++i)
+         {
+            if (!function(i))
+               stop.store(true);
+         }
+      }
+   };
+
+   if (threadCount <= 1)
+   {
+      worker();
+      return;
+   }
+
+   std::thread threads[kMaxThreads];
+   for (unsigned t = 0; t < threadCount; ++t)
+      threads[t] = std::thread(worker);
+   for (unsigned t = 0; t < threadCount; ++t)
+      threads[t].join();
+}
+
+// Text of the exception thrown by the code under test, e.g. tested::Fail() in worker thread
+inline void PrintCurrentException(Writer& out)
+{
+   try
+   {
+      throw;
+   }
+   catch (const CaseFailed& failed)
+   {
+      out.Printf("failed: %s", failed.Message.CData());
+   }
+   catch (const std::exception& ex)
+   {
+      out.Printf("threw: %s", ex.what());
+   }
+   catch (...)
+   {
+      out.Printf("threw unknown exception");
+   }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Differential testing
+//-------------------------------------------------------------------------------------------------
+
+// One of the implementations of the same interface, e.g. scalar reference, SIMD, multithreaded
+template <typename InputT, typename OutputT>
+struct Implementation
+{
+   const char* Name;
+   OutputT   (*Run)(const InputT& input);
+};
+
+struct DiffOptions
+{
+   size_t   Inputs;     // inputs to generate
+   unsigned Threads;    // 0 is one thread for each cpu
+   uint64_t Seed;
+   int64_t  OnlyInput;  // replay the single input reported by the failure, -1 for all
+
+   DiffOptions() : Inputs(1000), Threads(0), Seed(DefaultSeed()), OnlyInput(DefaultOnlyInput()) {}
+};
+
+// Runs all the implementations on the generated inputs and compares their outputs with the
+// output of the first one. The case fails with the first (lowest index) diverging input. The
+// generator makes the input from Rng and the input index: InputT generate(Rng&, size_t).
+template <typename InputT, typename OutputT, size_t N, typename GeneratorT, typename EqualT = Equal>
+inline void Differential(const Implementation<InputT, OutputT> (&implementations)[N],
+   GeneratorT generate, DiffOptions options = DiffOptions(), EqualT equal = EqualT())
+{
+   static_assert(N >= 2, "Differential testing needs at least two implementations");
+
+   std::mutex failureLock;
+   std::atomic<size_t> failedInput(SIZE_MAX);
+   Text<2048> failure;
+
+   const size_t first = options.OnlyInput >= 0 ? static_cast<size_t>(options.OnlyInput) : 0;
+   const size_t count = options.OnlyInput >= 0 ? 1 : options.Inputs;
+
+   ParallelFor(count, options.Threads, [&](size_t i)
+   {
+      const size_t index = first + i;
+      if (index > failedInput.load(std::memory_order_relaxed))
+         return false;
+
+      Text<1024> diverged;
+      auto compare = [&](const InputT& input)
+      {
+         OutputT expected = OutputT();
+         for (size_t impl = 0; impl < N && diverged.Out.Length == 0; ++impl)
+         {
+            Writer& out = diverged.Out;
+            try
+            {
+               if (impl == 0)
+               {
+                  expected = implementations[0].Run(input);
+                  continue;
+               }
+
+               const OutputT actual = implementations[impl].Run(input);
+               if (!equal(expected, actual))
+               {
+                  out.Printf("'%s' differs from '%s'\n   input: ", implementations[impl].Name,
+                     implementations[0].Name);
+                  Print(out, input);
+                  out.Printf("\n   %s: ", implementations[0].Name);
+                  Print(out, expected);
+                  out.Printf("\n   %s: ", implementations[impl].Name);
+                  Print(out, actual);
+               }
+            }
+            catch (...)
+            {
+               out.Printf("'%s' ", implementations[impl].Name);
+               PrintCurrentException(out);
+               out.Printf("\n   input: ");
+               Print(out, input);
+            }
+         }
+      };
+
+      // The generator which throws fails this input instead of the whole process
+      Rng rng(options.Seed, index);
+      try
+      {
+         compare(generate(rng, index));
+      }
+      catch (...)
+      {
+         diverged.Out.Printf("generator ");
+         PrintCurrentException(diverged.Out);
+      }
+
+      if (diverged.Out.Length == 0)
+         return true;
+
+      std::lock_guard<std::mutex> lock(failureLock);
+      if (index < failedInput.load())
+      {
+         failedInput.store(index);
+         failure.Out.Length = 0;
+         failure.Out.Printf("Input #%zu (TESTED_SEED=0x%llx TESTED_INPUT=%zu): %s", index,
+            static_cast<unsigned long long>(options.Seed), index, diverged.CData());
+      }
+      return false;
+   });
+
+   if (failedInput.load() != SIZE_MAX)
+      Fail(failure.CData());
+}
+
+//-------------------------------------------------------------------------------------------------
+// Property-based testing
+//-------------------------------------------------------------------------------------------------
+//
+// The generator is any type with:
+//
+//    Value Generate(Rng& rng) const;
+//    bool Shrink(const Value& value, SinkT sink) const;
+//
+// Shrink() offers the simpler candidates to the sink from the simplest one, sink(candidate)
+// returns true when the candidate is taken and the enumeration must stop; Shrink() returns true
+// if it was stopped so. Arbitrary<T> is the default generator of the type, specialize it or pass
+// the generator object for the user types.
+
+// Integers in [low, high], the bounds and the value nearest to zero come more often
+template <typename T>
+struct Ints
+{
+   T Low;
+   T High;
+
+   explicit Ints(T low = (std::numeric_limits<T>::min)(), T high = (std::numeric_limits<T>::max)())
+      : Low(low), High(high)
+   {}
+
+   // Shrinking goes towards zero or the nearest bound
+   T Target() const { return Low > T() ? Low : (High < T() ? High : T()); }
+
+   T Generate(Rng& rng) const
+   {
+      switch (rng.Below(8))
+      {
+      case 0: return Low;
+      case 1: return High;
+      case 2: return Target();
+      default: break;
+      }
+      // Modular arithmetic on the unsigned values is valid for the signed types as well
+      const uint64_t span = static_cast<uint64_t>(High) - static_cast<uint64_t>(Low);
+      const uint64_t offset = span == UINT64_MAX ? rng.Next() : rng.Below(span + 1);
+      return static_cast<T>(static_cast<uint64_t>(Low) + offset);
+   }
+
+   template <typename SinkT>
+   bool Shrink(const T& value, SinkT sink) const
+   {
+      const T target = Target();
+      if (value == target)
+         return false;
+      if (sink(target))
+         return true;
+
+      // Halfway points from the value towards the target, from the farthest one
+      const bool above = value > target;
+      const uint64_t distance = above
+         ? static_cast<uint64_t>(value) - static_cast<uint64_t>(target)
+         : static_cast<uint64_t>(target) - static_cast<uint64_t>(value);
+      for (uint64_t step = distance / 2; step > 0; step /= 2)
+      {
+         const uint64_t candidate = above
+            ? static_cast<uint64_t>(value) - step
+            : static_cast<uint64_t>(value) + step;
+         if (sink(static_cast<T>(candidate)))
+            return true;
+      }
+      return false;
+   }
+};
+
+// Finite floating point values in [low, high], NaN and infinities are not generated
+template <typename T>
+struct Floats
+{
+   T Low;
+   T High;
+
+   explicit Floats(T low = T(-1e6), T high = T(1e6)) : Low(low), High(high) {}
+
+   T Target() const { return Low > T() ? Low : (High < T() ? High : T()); }
+
+   T Generate(Rng& rng) const
+   {
+      switch (rng.Below(8))
+      {
+      case 0: return Low;
+      case 1: return High;
+      case 2: return Target();
+      default: break;
+      }
+      const T value = static_cast<T>(Low + (static_cast<double>(High) - Low) * rng.Unit());
+      return (std::min)((std::max)(value, Low), High);
+   }
+
+   template <typename SinkT>
+   bool Shrink(const T& value, SinkT sink) const
+   {
+      const T target = Target();
+      if (value == target)
+         return false;
+      if (sink(target))
+         return true;
+
+      const T whole = static_cast<T>(static_cast<long long>(value));
+      if (whole != value && whole >= Low && whole <= High && sink(whole))
+         return true;
+
+      const T half = target + (value - target) / 2;
+      return half != value && half != target && sink(half);
+   }
+};
+
+// Characters from the alphabet, shrinking goes to the first one
+struct Chars
+{
+   const char* Alphabet;
+
+   explicit Chars(const char* alphabet = nullptr) : Alphabet(alphabet) {}
+
+   char Generate(Rng& rng) const
+   {
+      if (Alphabet == nullptr)
+         return static_cast<char>(rng.Range(0x20, 0x7e));
+      return Alphabet[rng.Below(strlen(Alphabet))];
+   }
+
+   template <typename SinkT>
+   bool Shrink(const char& value, SinkT sink) const
+   {
+      const char simplest = Alphabet == nullptr ? 'a' : Alphabet[0];
+      return value != simplest && sink(simplest);
+   }
+};
+
+// Sequence containers (std::vector, std::string, std::deque) with up to MaxSize elements
+template <typename ContainerT, typename ElementsT>
+struct Containers
+{
+   ElementsT Elements;
+   size_t    MaxSize;
+
+   explicit Containers(ElementsT elements = ElementsT(), size_t maxSize = 32)
+      : Elements(elements), MaxSize(maxSize)
+   {}
+
+   ContainerT Generate(Rng& rng) const
+   {
+      ContainerT container;
+      const size_t size = static_cast<size_t>(rng.Below(MaxSize + 1));
+      for (size_t i = 0; i < size; ++i)
+         container.push_back(Elements.Generate(rng));
+      return container;
+   }
+
+   // Removes the chunks of elements from the halves down to single ones, then shrinks elements
+   template <typename SinkT>
+   bool Shrink(const ContainerT& value, SinkT sink) const
+   {
+      const size_t size = value.size();
+      for (size_t chunk = size; chunk > 0; chunk /= 2)
+      {
+         for (size_t start = 0; start + chunk <= size; start += chunk)
+         {
+            ContainerT candidate(value.begin(), value.begin() + start);
+            candidate.insert(candidate.end(), value.begin() + start + chunk, value.end());
+            if (sink(candidate))
+               return true;
+         }
+      }
+
+      for (size_t i = 0; i < size; ++i)
+      {
+         const bool taken = Elements.Shrink(value[i], [&](const auto& element)
+         {
+            ContainerT candidate(value);
+            candidate[i] = element;
+            return sink(candidate);
+         });
+         if (taken)
+            return true;
+      }
+      return false;
+   }
+};
+
+template <typename ElementsT>
+using Vectors = Containers<std::vector<decltype(std::declval<ElementsT>().Generate(
+   std::declval<Rng&>()))>, ElementsT>;
+
+typedef Containers<std::string, Chars> Strings;
+
+template <typename FirstT, typename SecondT>
+struct Pairs
+{
+   FirstT  First;
+   SecondT Second;
+
+   explicit Pairs(FirstT first = FirstT(), SecondT second = SecondT())
+      : First(first), Second(second)
+   {}
+
+   auto Generate(Rng& rng) const
+   {
+      auto first = First.Generate(rng);
+      auto second = Second.Generate(rng);
+      return std::make_pair(first, second);
+   }
+
+   template <typename ValueT, typename SinkT>
+   bool Shrink(const ValueT& value, SinkT sink) const
+   {
+      const bool taken = First.Shrink(value.first, [&](const auto& first)
+      {
+         return sink(ValueT(first, value.second));
+      });
+      return taken || Second.Shrink(value.second, [&](const auto& second)
+      {
+         return sink(ValueT(value.first, second));
+      });
+   }
+};
+
+// The generator which can not shrink, e.g. for the user types made by a function
+template <typename FunctionT>
+struct FromFunction
+{
+   FunctionT Function;
+
+   auto Generate(Rng& rng) const { return Function(rng); }
+
+   template <typename ValueT, typename SinkT>
+   bool Shrink(const ValueT&, SinkT) const { return false; }
+};
+
+template <typename FunctionT>
+inline FromFunction<FunctionT> From(FunctionT function) { return FromFunction<FunctionT>{function}; }
+
+// Default generator of the type
+template <typename T, typename Enable = void>
+struct Arbitrary;
+
+template <typename T>
+struct Arbitrary<T, std::enable_if_t<std::is_integral_v<T>>> : Ints<T> {};
+
+template <typename T>
+struct Arbitrary<T, std::enable_if_t<std::is_floating_point_v<T>>> : Floats<T> {};
+
+template <>
+struct Arbitrary<std::string> : Strings {};
+
+template <typename T>
+struct Arbitrary<std::vector<T>> : Containers<std::vector<T>, Arbitrary<T>> {};
+
+template <typename FirstT, typename SecondT>
+struct Arbitrary<std::pair<FirstT, SecondT>> : Pairs<Arbitrary<FirstT>, Arbitrary<SecondT>> {};
+
+struct PropertyOptions : DiffOptions
+{
+   size_t MaxShrinks; // shrinking steps before the counterexample is reported as it is
+
+   PropertyOptions() : MaxShrinks(1000) {}
+};
+
+// Checks the property on the value, it fails if it returns false, fails or throws
+template <typename PropertyT, typename T>
+inline bool Holds(PropertyT& property, const T& value, Writer& reason)
+{
+   try
+   {
+      if constexpr (std::is_void_v<decltype(property(value))>)
+      {
+         property(value);
+         return true;
+      }
+      else
+      {
+         if (property(value))
+            return true;
+         reason.Printf("returned false");
+         return false;
+      }
+   }
+   catch (...)
+   {
+      PrintCurrentException(reason);
+      return false;
+   }
+}
+
+// Makes the input of the index again, the generator which throws fails the case
+template <typename GeneratorT>
+inline auto Regenerate(const GeneratorT& generator, const PropertyOptions& options, size_t index)
+{
+   Rng rng(options.Seed, index);
+   try
+   {
+      return generator.Generate(rng);
+   }
+   catch (...)
+   {
+      Text<512> failure;
+      failure.Out.Printf("Generator failed on input #%zu (TESTED_SEED=0x%llx TESTED_INPUT=%zu): ",
+         index, static_cast<unsigned long long>(options.Seed), index);
+      PrintCurrentException(failure.Out);
+      throw CaseFailed(failure.CData());
+   }
+}
+
+// Checks the property on the generated values in the threads (the property must be thread-safe,
+// otherwise set the Threads option to 1). The first (lowest index) failing value is shrunk and
+// the case fails with the minimal counterexample.
+template <typename GeneratorT, typename PropertyT>
+inline void Property(const GeneratorT& generator, PropertyT property,
+   PropertyOptions options = PropertyOptions())
+{
+   typedef decltype(generator.Generate(std::declval<Rng&>())) Value;
+
+   std::atomic<size_t> failedInput(SIZE_MAX);
+   const size_t first = options.OnlyInput >= 0 ? static_cast<size_t>(options.OnlyInput) : 0;
+   const size_t count = options.OnlyInput >= 0 ? 1 : options.Inputs;
+
+   ParallelFor(count, options.Threads, [&](size_t i)
+   {
+      const size_t index = first + i;
+      if (index > failedInput.load(std::memory_order_relaxed))
+         return false;
+
+      // The generator which throws fails this input, the failure is reported when the input is
+      // made again below
+      Rng rng(options.Seed, index);
+      Text<256> reason;
+      bool holds = false;
+      try
+      {
+         holds = Holds(property, generator.Generate(rng), reason.Out);
+      }
+      catch (...)
+      {
+      }
+      if (holds)
+         return true;
+
+      size_t known = failedInput.load();
+      while (index < known && !failedInput.compare_exchange_weak(known, index))
+         ;
+      return false;
+   });
+
+   const size_t index = failedInput.load();
+   if (index == SIZE_MAX)
+      return;
+
+   // Inputs are generated from the index, so the failing one is made again instead of stored
+   const Value original = Regenerate(generator, options, index);
+   Value current = original;
+   Text<256> reason;
+   if (Holds(property, current, reason.Out))
+      reason.Out.Printf("flaky, the property holds on the second run");
+
+   size_t steps = 0;
+   while (steps < options.MaxShrinks)
+   {
+      Value next = current;
+      Text<256> nextReason;
+      const bool shrunk = generator.Shrink(current, [&](const Value& candidate)
+      {
+         nextReason.Out.Length = 0;
+         if (Holds(property, candidate, nextReason.Out))
+            return false;
+         next = candidate;
+         return true;
+      });
+      if (!shrunk)
+         break;
+
+      current = next;
+      reason.Out.Length = 0;
+      reason.Out.Printf("%s", nextReason.CData());
+      ++steps;
+   }
+
+   Text<1024> failure;
+   failure.Out.Printf("Property failed on input #%zu (TESTED_SEED=0x%llx TESTED_INPUT=%zu): %s"
+      "\n   counterexample: ", index, static_cast<unsigned long long>(options.Seed), index,
+      reason.CData());
+   Print(failure.Out, current);
+   failure.Out.Printf("\n   original (shrunk in %zu steps): ", steps);
+   Print(failure.Out, original);
+   Fail(failure.CData());
+}
+
+} // namespace check
+} // namespace tested
@@ -0,0 +1,251 @@
+//
+//   \|/ Tested
+//   /|\ Coroutines
+//
+//  C++20 coroutine cases on top of the async cases. The body of the case is a coroutine which
+//  returns tested::Task and awaits the timers, the descriptors, the nested tasks and any other
+//  awaitable, so the I/O bound case reads top down instead of the chain of callbacks:
+//
+//     template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+//     {
+//        tested::StartTask(runtime, "echo", 1000, [](int port) -> tested::Task
+//        {
+//           Connection connection(port);
+//           connection.Send("ping");
+//           co_await tested::Readable(connection.Fd());
+//           tested::Eq(connection.Receive(), "ping", "Echo is received");
+//        }, 7);
+//     }
+//
+//  Each task is the async case: it runs on the single thread of EventLoop with the other cases
+//  in flight and the exception which escapes it is the result of its case, whichever callback
+//  resumed it. The frame of the task is destroyed when the case is over, also when it times out
+//  in the middle of co_await. Subset::LimitAsync() sets how many of the cases are in flight.
+//
+//  The header is empty unless the compiler supports coroutines (TESTED_CORO_SUPPORTED).
+//
+#pragma once
+
+#include "tested_async.h"
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define TESTED_CORO_SUPPORTED 1
+#endif
+#endif
+
+#if defined(TESTED_CORO_SUPPORTED)
+
+#include <chrono>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+namespace tested {
+
+// Coroutine without the value. It starts when it is awaited by another task or by StartTask().
+class Task
+{
+public:
+   struct promise_type;
+   typedef std::coroutine_handle<promise_type> Handle_t;
+
+   // The finished task resumes the task which awaits it, or reports the result of its case
+   struct FinalAwaiter
+   {
+      bool await_ready() const noexcept { return false; }
+
+      std::coroutine_handle<> await_suspend(Handle_t handle) noexcept
+      {
+         promise_type& promise = handle.promise();
+         if (promise.Continuation)
+            return promise.Continuation;
+
+         // The case may be over with this report and its frame destroyed, so nothing refers to it
+         if (promise.Detached)
+            Report(promise.Done, promise.Exception);
+         return std::noop_coroutine();
+      }
+
+      void await_resume() const noexcept {}
+   };
+
+   struct promise_type
+   {
+      std::coroutine_handle<> Continuation; // the awaiting task, none for the body of the case
+      std::exception_ptr      Exception;
+      Completion              Done;         // the case of the task started by StartTask()
+      bool                    Detached = false;
+
+      Task get_return_object() { return Task(Handle_t::from_promise(*this)); }
+      std::suspend_always initial_suspend() const noexcept { return {}; }
+      FinalAwaiter final_suspend() const noexcept { return {}; }
+      void return_void() const {}
+
+      void unhandled_exception()
+      {
+         // The process state is compromised, so it is not the result of one case
+         try
+         {
+            throw;
+         }
+         catch (const ProcessCorruptedException&)
+         {
+            throw;
+         }
+         catch (...)
+         {
+            Exception = std::current_exception();
+         }
+      }
+   };
+
+   Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, Handle_t())) {}
+   Task(const Task&) = delete;
+   Task& operator=(const Task&) = delete;
+   Task& operator=(Task&&) = delete;
+
+   ~Task()
+   {
+      if (m_handle)
+         m_handle.destroy();
+   }
+
+   // The awaiting task goes on when the nested one finishes, the failure of the nested task is
+   // thrown in the awaiting one
+   bool await_ready() const noexcept { return false; }
+
+   std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+   {
+      m_handle.promise().Continuation = awaiting;
+      return m_handle;
+   }
+
+   void await_resume() const
+   {
+      if (m_handle.promise().Exception)
+         std::rethrow_exception(m_handle.promise().Exception);
+   }
+
+   // Runs the task as the body of the async case, the frame lives until the case is over
+   void Start(const Completion& done)
+   {
+      EventLoop::Instance().AtOwnerDone([handle = m_handle] { handle.destroy(); });
+
+      const Handle_t handle = std::exchange(m_handle, Handle_t());
+      handle.promise().Done = done;
+      handle.promise().Detached = true;
+      handle.resume();
+   }
+
+private:
+   explicit Task(Handle_t handle) : m_handle(handle) {}
+
+   static void Report(const Completion done, const std::exception_ptr exception) noexcept
+   {
+      if (!exception)
+      {
+         done.Pass();
+         return;
+      }
+
+      try
+      {
+         std::rethrow_exception(exception);
+      }
+      catch (const CaseFailed& ex)
+      {
+         done.Fail(ex.Message.CData());
+      }
+      catch (CaseSkipped)
+      {
+         done.Skip();
+      }
+      catch (const std::exception& ex)
+      {
+         done.Fail(ex.what());
+      }
+      catch (...)
+      {
+         done.Fail("Unknown exception");
+      }
+   }
+
+   Handle_t m_handle;
+};
+
+// Starts the async case which body is the coroutine, see IRuntime::StartAsyncCase(). The body
+// must not capture: the lambda is gone when the task resumes, so the state is passed by value
+// through the arguments, they are kept in the frame of the task.
+template <typename BodyT, typename... ArgsT>
+void StartTask(IRuntime* runtime, const char* caseName, int timeoutMs, BodyT body, ArgsT... args)
+{
+   static_assert(std::is_empty<BodyT>::value || std::is_pointer<BodyT>::value,
+      "The body of the task must not capture, pass the state as the arguments");
+
+   const Completion done = runtime->StartAsyncCase(caseName, timeoutMs);
+   Task task = body(std::move(args)...);
+   task.Start(done);
+}
+
+// Resumes the task after the delay, Sleep(0) lets the other cases run
+class Sleep
+{
+public:
+   explicit Sleep(int milliseconds) : m_milliseconds(milliseconds) {}
+
+   template <typename RepT, typename PeriodT>
+   explicit Sleep(std::chrono::duration<RepT, PeriodT> delay)
+      : m_milliseconds(static_cast<int>(
+         std::chrono::duration_cast<std::chrono::milliseconds>(delay).count()))
+   {}
+
+   bool await_ready() const noexcept { return false; }
+
+   void await_suspend(std::coroutine_handle<> task) const
+   {
+      EventLoop::Instance().After(m_milliseconds, [task] { task.resume(); });
+   }
+
+   void await_resume() const noexcept {}
+
+private:
+   int m_milliseconds;
+};
+
+// Resumes the task when the descriptor is ready for the events or has an error, co_await gives
+// the ready events
+class Ready
+{
+public:
+   Ready(int fd, unsigned events) : m_fd(fd), m_events(events), m_ready(0) {}
+
+   bool await_ready() const noexcept { return false; }
+
+   // The awaiter is in the frame of the suspended task, so the callback refers to it
+   void await_suspend(std::coroutine_handle<> task)
+   {
+      EventLoop::Instance().Watch(m_fd, m_events, [this, task](unsigned events)
+      {
+         m_ready = events;
+         task.resume();
+      });
+   }
+
+   unsigned await_resume() const noexcept { return m_ready; }
+
+private:
+   int      m_fd;
+   unsigned m_events;
+   unsigned m_ready;
+};
+
+#if defined(TESTED_EPOLL_SUPPORTED)
+inline Ready Readable(int fd) { return Ready(fd, EPOLLIN); }
+inline Ready Writable(int fd) { return Ready(fd, EPOLLOUT); }
+#endif
+
+} // namespace tested
+
+#endif
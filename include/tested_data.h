@@ -0,0 +1,543 @@
+//
+//   \|/ Tested
+//   /|\ Test data
+//
+//  The backend for large read-only test data files. Instead of reading the fixture file with
+//  fread() into a vector in every case, the case asks for the mapping of the file:
+//
+//     template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+//     {
+//        runtime->StartCase("decode");
+//        const tested::data::Bytes frames = tested::data::Map("video/frames.bin");
+//        ...
+//     }
+//
+//  Each file is mapped once per process and stays mapped until the process exit, so the spans
+//  handed out to the cases are never copied. The mapping is read-only and backed by the page
+//  cache: parallel cases and forked workers (tested_forked.h) share the same physical pages.
+//  Relative paths are resolved against TESTED_DATA_DIR environment variable if it is set.
+//
+#pragma once
+
+#include "tested.h"
+
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TESTED_DATA_MMAP 1
+#endif
+
+namespace tested {
+namespace data {
+
+enum
+{
+   kMaxMappedFiles = 64,
+   kMaxPath = 512
+};
+
+// Hint about how the case is going to read the data
+enum Prefetch_t
+{
+   Prefetch_None,       // pages are faulted in on the first access
+   Prefetch_Populate,   // read the whole file into page cache when it is mapped (MAP_POPULATE)
+   Prefetch_WillNeed,   // start asynchronous read ahead of the whole file
+   Prefetch_Sequential, // aggressive read ahead, pages can be dropped soon after access
+   Prefetch_Random      // no read ahead
+};
+
+// Read-only span of bytes
+struct Bytes
+{
+   const unsigned char* Data;
+   size_t               Size;
+
+   Bytes() : Data(nullptr), Size(0) {}
+   Bytes(const void* data, size_t size) : Data(static_cast<const unsigned char*>(data)), Size(size)
+   {}
+
+   const unsigned char* begin() const { return Data; }
+   const unsigned char* end() const { return Data + Size; }
+   size_t size() const { return Size; }
+   bool empty() const { return Size == 0; }
+   unsigned char operator[](size_t index) const { return Data[index]; }
+
+   // Part of the span, clamped to its size
+   Bytes Sub(size_t offset, size_t size = SIZE_MAX) const
+   {
+      offset = (std::min)(offset, Size);
+      return Bytes(Data + offset, (std::min)(size, Size - offset));
+   }
+
+   std::string_view View() const
+   {
+      return std::string_view(reinterpret_cast<const char*>(Data), Size);
+   }
+
+   // The data as array of trivial records, the tail which does not fit the record is ignored
+   template <typename T>
+   const T* As() const { return reinterpret_cast<const T*>(Data); }
+
+   template <typename T>
+   size_t Count() const { return Size / sizeof(T); }
+};
+
+// Low level mapping functions, failures are reported by failing the case
+struct FileMapping
+{
+   // Relative path is resolved against TESTED_DATA_DIR
+   static void ResolvePath(const char* path, char (&fullPath)[kMaxPath])
+   {
+      const char* directory = getenv("TESTED_DATA_DIR");
+      int length = 0;
+      if (path[0] != '/' && directory != nullptr && directory[0] != 0)
+         length = snprintf(fullPath, kMaxPath, "%s/%s", directory, path);
+      else
+         length = snprintf(fullPath, kMaxPath, "%s", path);
+
+      if (length < 0 || length >= kMaxPath)
+         Fail("Test data path is too long");
+   }
+
+   static bool Exists(const char* path)
+   {
+#if defined(TESTED_DATA_MMAP)
+      struct stat info;
+      return stat(path, &info) == 0;
+#else
+      FILE* file = fopen(path, "rb");
+      if (file != nullptr)
+         fclose(file);
+      return file != nullptr;
+#endif
+   }
+
+   static Bytes Map(const char* path, Prefetch_t prefetch)
+   {
+      StringStorage<kMaxPath + 64> message;
+#if defined(TESTED_DATA_MMAP)
+      const int fd = open(path, O_RDONLY);
+      if (fd < 0)
+      {
+         snprintf(message.Data(), message.MaxSize(), "Cannot open test data '%s'", path);
+         Fail(message.CData());
+      }
+
+      struct stat info;
+      if (fstat(fd, &info) != 0)
+      {
+         close(fd);
+         snprintf(message.Data(), message.MaxSize(), "Cannot stat test data '%s'", path);
+         Fail(message.CData());
+      }
+
+      void* address = nullptr;
+      const size_t size = static_cast<size_t>(info.st_size);
+      if (size > 0)
+      {
+         int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+         if (prefetch == Prefetch_Populate)
+            flags |= MAP_POPULATE;
+#endif
+         address = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+      }
+      close(fd); // the mapping keeps the file referenced
+
+      if (address == MAP_FAILED)
+      {
+         snprintf(message.Data(), message.MaxSize(), "Cannot map test data '%s'", path);
+         Fail(message.CData());
+      }
+
+      const Bytes bytes(address, size);
+      if (prefetch != Prefetch_Populate)
+         Advise(bytes, prefetch);
+      return bytes;
+#else
+      (void)prefetch;
+      snprintf(message.Data(), message.MaxSize(),
+         "Mapping of test data '%s' is not supported on this platform", path);
+      Fail(message.CData());
+      return Bytes();
+#endif
+   }
+
+   static void Advise(const Bytes& bytes, Prefetch_t prefetch)
+   {
+#if defined(TESTED_DATA_MMAP)
+      if (bytes.empty())
+         return;
+
+      void* address = const_cast<unsigned char*>(bytes.Data);
+      switch (prefetch)
+      {
+      case Prefetch_None: break;
+      case Prefetch_Populate:
+      case Prefetch_WillNeed:   madvise(address, bytes.Size, MADV_WILLNEED);   break;
+      case Prefetch_Sequential: madvise(address, bytes.Size, MADV_SEQUENTIAL); break;
+      case Prefetch_Random:     madvise(address, bytes.Size, MADV_RANDOM);     break;
+      }
+#else
+      (void)bytes;
+      (void)prefetch;
+#endif
+   }
+
+   static void Unmap(const Bytes& bytes)
+   {
+#if defined(TESTED_DATA_MMAP)
+      if (!bytes.empty())
+         munmap(const_cast<unsigned char*>(bytes.Data), bytes.Size);
+#else
+      (void)bytes;
+#endif
+   }
+};
+
+// The registry of the mapped files of the process
+class MappedFiles
+{
+public:
+   // Maps the file or returns the existing mapping, fails the case if the file cannot be mapped
+   static Bytes Map(const char* path, Prefetch_t prefetch = Prefetch_None)
+   {
+      char fullPath[kMaxPath];
+      FileMapping::ResolvePath(path, fullPath);
+
+      MappedFiles& files = Instance();
+      std::lock_guard<std::mutex> lock(files.m_lock);
+
+      Entry* entry = files.Find(fullPath);
+      if (entry == nullptr)
+      {
+         if (files.m_count == kMaxMappedFiles)
+            Fail("Too many mapped test data files");
+
+         entry = &files.m_entries[files.m_count];
+         entry->Bytes = FileMapping::Map(fullPath, prefetch);
+         entry->Path.Assign(fullPath);
+         files.m_count += 1;
+      }
+      else if (prefetch != Prefetch_None)
+      {
+         FileMapping::Advise(entry->Bytes, 
+            prefetch == Prefetch_Populate ? Prefetch_WillNeed : prefetch);
+      }
+
+      return entry->Bytes;
+   }
+
+   // Unmaps all the files, the spans handed out before become invalid
+   static void UnmapAll()
+   {
+      MappedFiles& files = Instance();
+      std::lock_guard<std::mutex> lock(files.m_lock);
+      for (int i = 0; i < files.m_count; ++i)
+         FileMapping::Unmap(files.m_entries[i].Bytes);
+      files.m_count = 0;
+   }
+
+private:
+   struct Entry
+   {
+      StringStorage<kMaxPath> Path;
+      data::Bytes             Bytes;
+   };
+
+   MappedFiles() : m_count(0) {}
+
+   static MappedFiles& Instance()
+   {
+      static MappedFiles s_files;
+      return s_files;
+   }
+
+   Entry* Find(const char* path)
+   {
+      for (int i = 0; i < m_count; ++i)
+      {
+         if (strcmp(m_entries[i].Path.CData(), path) == 0)
+            return &m_entries[i];
+      }
+      return nullptr;
+   }
+
+   std::mutex m_lock;
+   Entry      m_entries[kMaxMappedFiles];
+   int        m_count;
+};
+
+// Read-only mapping of the test data file, see MappedFiles::Map()
+inline Bytes Map(const char* path, Prefetch_t prefetch = Prefetch_None)
+{
+   return MappedFiles::Map(path, prefetch);
+}
+
+// Directory walk for GeneratedGroup: adds the case for each file with the suffix, the case name 
+// is the file name without the suffix and the data is the path. Files are added in the order of
+// names, so the cases have the same order on each run and in each forked worker. The case which
+// path does not fit kMaxPath gets empty data, as the missing directory does:
+//
+//    static tested::GeneratedGroup<4096, 256 * 1024> x("codec.pairs", __FILE__, 
+//       [](tested::CaseSink& sink) { tested::data::AddFiles(sink, "codec", ".in"); }, CheckPair);
+//
+inline void AddFiles(CaseSink& sink, const char* directory, const char* suffix = "")
+{
+   char fullPath[kMaxPath];
+   FileMapping::ResolvePath(directory, fullPath);
+
+#if defined(TESTED_DATA_MMAP)
+   dirent** entries = nullptr;
+   const int count = scandir(fullPath, &entries, nullptr, alphasort);
+   if (count < 0)
+   {
+      // Missing directory is the case with empty data, so the run does not pass silently
+      sink.Add(fullPath, std::string_view());
+      return;
+   }
+
+   const size_t suffixLength = strlen(suffix);
+   bool full = false;
+   for (int i = 0; i < count; ++i)
+   {
+      const char* name = entries[i]->d_name;
+      const size_t nameLength = strlen(name);
+      if (!full && name[0] != '.' && nameLength > suffixLength &&
+         strcmp(name + nameLength - suffixLength, suffix) == 0)
+      {
+         // The case with the truncated path would map the wrong file, so it gets no data
+         char path[kMaxPath];
+         const int length = snprintf(path, sizeof(path), "%s/%s", fullPath, name);
+         const bool fits = length >= 0 && length < kMaxPath;
+         full = !sink.Add(std::string_view(name, nameLength - suffixLength),
+            fits ? std::string_view(path) : std::string_view());
+      }
+      free(entries[i]);
+   }
+   free(entries);
+#else
+   (void)suffix;
+   sink.Add(fullPath, std::string_view());
+#endif
+}
+
+// Golden file snapshot. The case writes its output in chunks and each chunk is compared with
+// the mapped golden file right away, so neither side is loaded into heap buffers and outputs of
+// hundred megabytes are fine. The first difference fails the case with the offset, line and
+// column of it:
+//
+//    tested::data::Snapshot snapshot("golden/report.txt");
+//    for (const Row& row: rows)
+//       snapshot.Write(Format(row));
+//    snapshot.Finish();
+//
+// With TESTED_UPDATE_GOLDEN=1 environment variable (or Snapshot::SetUpdateMode) the output is
+// written to a temporary file next to the golden one and renamed over it by Finish(), so an
+// interrupted update never leaves a truncated golden file.
+class Snapshot
+{
+public:
+   explicit Snapshot(const char* goldenPath) : m_offset(0), m_update(nullptr)
+   {
+      FileMapping::ResolvePath(goldenPath, m_path.StorageBuf);
+
+      StringStorage<kMaxPath + 96> message;
+      if (UpdateMode())
+      {
+         snprintf(m_tmpPath.Data(), m_tmpPath.MaxSize(), "%s.tmp.%d", m_path.CData(), ProcessId());
+         m_update = fopen(m_tmpPath.CData(), "wb");
+         if (m_update == nullptr)
+         {
+            snprintf(message.Data(), message.MaxSize(), "Cannot write golden file '%s'", 
+               m_tmpPath.CData());
+            Fail(message.CData());
+         }
+         return;
+      }
+
+      if (!FileMapping::Exists(m_path.CData()))
+      {
+         snprintf(message.Data(), message.MaxSize(), 
+            "Golden file '%s' does not exist, run with TESTED_UPDATE_GOLDEN=1 to create it", 
+            m_path.CData());
+         Fail(message.CData());
+      }
+      m_golden = FileMapping::Map(m_path.CData(), Prefetch_Sequential);
+   }
+
+   ~Snapshot()
+   {
+      FileMapping::Unmap(m_golden);
+      if (m_update != nullptr)
+      {
+         // The case failed before Finish(), the golden file is not touched
+         fclose(m_update);
+         remove(m_tmpPath.CData());
+      }
+   }
+
+   Snapshot(const Snapshot&) = delete;
+   Snapshot& operator=(const Snapshot&) = delete;
+
+   void Write(std::string_view text) { Write(text.data(), text.size()); }
+
+   void Write(const void* data, size_t size)
+   {
+      if (m_update != nullptr)
+      {
+         if (fwrite(data, 1, size, m_update) != size)
+            Fail("Cannot write golden file");
+         m_offset += size;
+         return;
+      }
+
+      const unsigned char* actual = static_cast<const unsigned char*>(data);
+      const size_t available = m_golden.Size - m_offset;
+      const size_t common = (std::min)(size, available);
+
+      // memcmp is the vectorized compare of libc, the byte loop only locates the difference
+      if (common > 0 && memcmp(m_golden.Data + m_offset, actual, common) != 0)
+      {
+         size_t at = 0;
+         while (m_golden.Data[m_offset + at] == actual[at])
+            ++at;
+         ReportDifference(m_offset + at, Bytes(actual + at, size - at));
+      }
+
+      if (size > available)
+         ReportDifference(m_golden.Size, Bytes(actual + common, size - common));
+      m_offset += size;
+   }
+
+   // Checks that the output is not shorter than golden file or commits the updated golden file
+   void Finish()
+   {
+      if (m_update != nullptr)
+      {
+         FILE* file = m_update;
+         m_update = nullptr;
+         const bool written = fflush(file) == 0 && SyncFile(file);
+         fclose(file);
+         if (!written || rename(m_tmpPath.CData(), m_path.CData()) != 0)
+         {
+            remove(m_tmpPath.CData());
+            Fail("Cannot replace golden file");
+         }
+         printf("Golden file '%s' updated, %zu bytes\n", m_path.CData(), m_offset);
+         return;
+      }
+
+      if (m_offset < m_golden.Size)
+         ReportDifference(m_offset, Bytes());
+   }
+
+   static bool& UpdateMode()
+   {
+      static bool s_update = EnvironmentUpdateMode();
+      return s_update;
+   }
+
+   static void SetUpdateMode(bool update) { UpdateMode() = update; }
+
+private:
+   static bool EnvironmentUpdateMode()
+   {
+      const char* value = getenv("TESTED_UPDATE_GOLDEN");
+      return value != nullptr && value[0] != 0 && strcmp(value, "0") != 0;
+   }
+
+   static int ProcessId()
+   {
+#if defined(TESTED_DATA_MMAP)
+      return static_cast<int>(getpid());
+#else
+      return 0;
+#endif
+   }
+
+   static bool SyncFile(FILE* file)
+   {
+#if defined(TESTED_DATA_MMAP)
+      return fsync(fileno(file)) == 0;
+#else
+      (void)file;
+      return true;
+#endif
+   }
+
+   // Printable excerpt of the data, non printable bytes are escaped
+   static void Excerpt(Bytes bytes, char* buffer, size_t bufferSize)
+   {
+      size_t used = 0;
+      for (size_t i = 0; i < bytes.Size && i < 24 && used + 5 < bufferSize; ++i)
+      {
+         const unsigned char c = bytes[i];
+         if (c == '\n')
+            used += snprintf(buffer + used, bufferSize - used, "\\n");
+         else if (c < 0x20 || c >= 0x7f || c == '\\')
+            used += snprintf(buffer + used, bufferSize - used, "\\x%02x", c);
+         else
+            buffer[used++] = static_cast<char>(c);
+      }
+      buffer[used] = 0;
+   }
+
+   [[noreturn]] void ReportDifference(size_t offset, Bytes actual) const
+   {
+      // The line of the difference is counted only when there is one
+      size_t line = 1;
+      size_t lineStart = 0;
+      for (const unsigned char* newLine = m_golden.Data; newLine != nullptr; )
+      {
+         newLine = static_cast<const unsigned char*>(
+            memchr(newLine, '\n', m_golden.Data + offset - newLine));
+         if (newLine == nullptr)
+            break;
+         ++line;
+         ++newLine;
+         lineStart = newLine - m_golden.Data;
+      }
+
+      char expected[128];
+      char got[128];
+      Excerpt(m_golden.Sub(offset), expected, sizeof(expected));
+      Excerpt(actual, got, sizeof(got));
+
+      StringStorage<kMaxPath + 512> message;
+      snprintf(message.Data(), message.MaxSize(),
+         "Output differs from golden file '%s' at byte %zu (line %zu, column %zu): "
+         "expected '%s'%s, actual '%s'%s",
+         m_path.CData(), offset, line, offset - lineStart + 1,
+         expected, offset >= m_golden.Size ? " (end of file)" : "",
+         got, actual.empty() ? " (end of output)" : "");
+      Fail(message.CData());
+      throw CaseFailed(); // Fail() always throws
+   }
+
+   StringStorage<kMaxPath>      m_path;
+   StringStorage<kMaxPath + 32> m_tmpPath;
+   Bytes                        m_golden;
+   size_t                       m_offset;
+   FILE*                        m_update;
+};
+
+// Compares the whole output with the golden file, see Snapshot
+inline void ExpectSnapshot(const char* goldenPath, std::string_view actual)
+{
+   Snapshot snapshot(goldenPath);
+   snapshot.Write(actual);
+   snapshot.Finish();
+}
+
+} // namespace data
+} // namespace tested
@@ -0,0 +1,284 @@
+//
+//   \|/ Tested
+//   /|\ Forked workers
+//
+//  The backend which runs the groups of the subset in forked worker processes. A worker crash
+//  fails the worker's cases but does not stop the run.
+//
+//  Shared resources (IRuntime::UseResource<T>) used by the selected cases are built once in the
+//  parent before the workers are forked, so the workers share the pages copy-on-write instead of
+//  rebuilding a gigabyte-sized fixture each. To confirm the memory stays shared, each worker
+//  reports its private dirty memory at exit:
+//
+//     tested::forked::Runner runner(tested::forked::Options(4));
+//     Subset::Stats stats = runner.Run(subset);
+//
+//  Groups are not split between workers (see Subset::Shard()), so a group fixture is still
+//  constructed once. Options::ShardByCase splits cases and rows of table cases instead, it is
+//  better for a few groups with many rows. The output of each worker is captured and printed 
+//  when the worker is done.
+//
+#pragma once
+
+#include "tested.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define TESTED_FORKED_SUPPORTED 1
+#endif
+
+namespace tested {
+namespace forked {
+
+enum { kMaxWorkers = 64 };
+
+struct Options
+{
+   int  Workers;
+   bool ShareResources; // build shared resources in the parent before fork
+   bool ShardByCase;    // split cases and table rows between workers instead of groups
+
+   explicit Options(int workers = 2) 
+      : Workers(workers), ShareResources(true), ShardByCase(false) 
+   {}
+};
+
+// Memory of the process in kilobytes, from /proc/self/smaps_rollup
+struct MemoryUsage
+{
+   long long RssKb;
+   long long PssKb;
+   long long SharedCleanKb;
+   long long SharedDirtyKb;
+   long long PrivateCleanKb;
+   long long PrivateDirtyKb;
+
+   MemoryUsage()
+      : RssKb(0), PssKb(0), SharedCleanKb(0), SharedDirtyKb(0), PrivateCleanKb(0),
+        PrivateDirtyKb(0)
+   {}
+
+   bool IsValid() const { return RssKb != 0; }
+
+   // The rollup is summed by the kernel, older kernels only have per-mapping smaps
+   static MemoryUsage OfSelf()
+   {
+      MemoryUsage usage;
+      FILE* file = fopen("/proc/self/smaps_rollup", "r");
+      if (file == nullptr)
+         file = fopen("/proc/self/smaps", "r");
+      if (file == nullptr)
+         return usage;
+
+      char line[256];
+      while (fgets(line, sizeof(line), file) != nullptr)
+      {
+         long long value = 0;
+         if (sscanf(line, "Rss: %lld kB", &value) == 1)
+            usage.RssKb += value;
+         else if (sscanf(line, "Pss: %lld kB", &value) == 1)
+            usage.PssKb += value;
+         else if (sscanf(line, "Shared_Clean: %lld kB", &value) == 1)
+            usage.SharedCleanKb += value;
+         else if (sscanf(line, "Shared_Dirty: %lld kB", &value) == 1)
+            usage.SharedDirtyKb += value;
+         else if (sscanf(line, "Private_Clean: %lld kB", &value) == 1)
+            usage.PrivateCleanKb += value;
+         else if (sscanf(line, "Private_Dirty: %lld kB", &value) == 1)
+            usage.PrivateDirtyKb += value;
+      }
+
+      fclose(file);
+      return usage;
+   }
+};
+
+// Written by the worker into the memory shared with the parent
+struct WorkerReport
+{
+   int           Pid;
+   bool          Finished;   // false if the worker died before the report
+   int           Signal;     // the signal which killed the worker or 0
+   Subset::Stats Stats;
+   MemoryUsage   Memory;
+};
+
+class Runner
+{
+public:
+   explicit Runner(Options options = Options()) : m_options(options)
+   {
+      if (m_options.Workers < 1)
+         m_options.Workers = 1;
+      if (m_options.Workers > kMaxWorkers)
+         m_options.Workers = kMaxWorkers;
+   }
+
+   // Runs the subset in the workers and returns the summary of them. The observer is used by
+   // each worker in its own process, the parent only prints the captured output.
+   Subset::Stats Run(Subset& subset, Subset::IRunObserver* observer = nullptr)
+   {
+      Subset::StdoutReporter consoleReporter;
+      if (observer == nullptr)
+         observer = &consoleReporter;
+
+#if defined(TESTED_FORKED_SUPPORTED)
+      if (m_options.ShareResources)
+         subset.BuildResources(observer);
+      m_parentMemory = MemoryUsage::OfSelf();
+
+      const size_t reportsSize = sizeof(WorkerReport) * m_options.Workers;
+      void* shared = mmap(nullptr, reportsSize, PROT_READ | PROT_WRITE,
+         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+      if (shared == MAP_FAILED)
+      {
+         printf("Failed to map worker reports, running in process\n");
+         return RunInProcess(subset, observer);
+      }
+
+      WorkerReport* reports = static_cast<WorkerReport*>(shared);
+      memset(shared, 0, reportsSize);
+
+      FILE* outputs[kMaxWorkers] = {};
+      int started = 0;
+      fflush(stdout);
+      fflush(stderr);
+      for (; started < m_options.Workers; ++started)
+      {
+         outputs[started] = tmpfile();
+         const pid_t pid = fork();
+         if (pid < 0)
+         {
+            if (outputs[started] != nullptr)
+               fclose(outputs[started]);
+            break;
+         }
+
+         if (pid == 0)
+            RunWorker(subset.Shard(started, m_options.Workers, m_options.ShardByCase), observer,
+               outputs[started], &reports[started]);
+
+         reports[started].Pid = static_cast<int>(pid);
+      }
+
+      Subset::Stats total;
+      for (int i = 0; i < started; ++i)
+      {
+         int status = 0;
+         waitpid(static_cast<pid_t>(reports[i].Pid), &status, 0);
+         if (WIFSIGNALED(status))
+            reports[i].Signal = WTERMSIG(status);
+
+         PrintOutput(outputs[i]);
+         if (reports[i].Finished)
+         {
+            total.Passed += reports[i].Stats.Passed;
+            total.Failed += reports[i].Stats.Failed;
+            total.Skipped += reports[i].Stats.Skipped;
+         }
+         else
+         {
+            printf("Worker %d (pid %d) died before the report, signal %d\n", i, reports[i].Pid,
+               reports[i].Signal);
+            total.Failed += 1;
+         }
+      }
+
+      // Shards of workers which failed to fork are run in this process
+      for (int i = started; i < m_options.Workers; ++i)
+      {
+         printf("Failed to fork worker %d, running its groups in process\n", i);
+         Subset shard = subset.Shard(i, m_options.Workers, m_options.ShardByCase);
+         const Subset::Stats stats = shard.Run(observer);
+         total.Passed += stats.Passed;
+         total.Failed += stats.Failed;
+         total.Skipped += stats.Skipped;
+      }
+
+      PrintMemory(reports, started);
+      munmap(shared, reportsSize);
+      Subset::ReleaseBuiltResources();
+      return total;
+#else
+      return RunInProcess(subset, observer);
+#endif
+   }
+
+private:
+   Subset::Stats RunInProcess(Subset& subset, Subset::IRunObserver* observer)
+   {
+      const Subset::Stats stats = subset.Run(observer);
+      Subset::ReleaseBuiltResources();
+      return stats;
+   }
+
+#if defined(TESTED_FORKED_SUPPORTED)
+   [[noreturn]] static void RunWorker(Subset shard, Subset::IRunObserver* observer,
+      FILE* output, WorkerReport* report)
+   {
+      if (output != nullptr)
+         dup2(fileno(output), STDOUT_FILENO);
+
+      int exitCode = 0;
+      try
+      {
+         report->Stats = shard.Run(observer);
+      }
+      catch (const TestrunException& ex)
+      {
+         printf("%s\n", ex.what());
+         report->Stats.Failed += 1;
+         exitCode = 1;
+      }
+
+      fflush(stdout);
+      report->Memory = MemoryUsage::OfSelf();
+      report->Finished = true;
+      _exit(exitCode);
+   }
+
+   static void PrintOutput(FILE* output)
+   {
+      if (output == nullptr)
+         return;
+
+      rewind(output);
+      char buffer[4096];
+      size_t size;
+      while ((size = fread(buffer, 1, sizeof(buffer), output)) > 0)
+         fwrite(buffer, 1, size, stdout);
+      fclose(output);
+   }
+
+   void PrintMemory(const WorkerReport* reports, int count) const
+   {
+      if (!m_parentMemory.IsValid())
+         return;
+
+      printf("\nMemory of workers, MB (parent rss %.1f after shared resources are built)\n",
+         m_parentMemory.RssKb / 1024.0);
+      printf("   worker        pid      rss      pss   shared  private dirty\n");
+      for (int i = 0; i < count; ++i)
+      {
+         const MemoryUsage& memory = reports[i].Memory;
+         if (!reports[i].Finished || !memory.IsValid())
+            continue;
+         printf("   %6d %10d %8.1f %8.1f %8.1f %8.1f\n", i, reports[i].Pid,
+            memory.RssKb / 1024.0, memory.PssKb / 1024.0,
+            (memory.SharedCleanKb + memory.SharedDirtyKb) / 1024.0,
+            memory.PrivateDirtyKb / 1024.0);
+      }
+   }
+#endif
+
+   Options     m_options;
+   MemoryUsage m_parentMemory;
+};
+
+} // namespace forked
+} // namespace tested
@@ -0,0 +1,861 @@
+//
+//   \|/ Tested
+//   /|\ Fuzzing
+//
+//  The backend which turns a case into the coverage-guided fuzz target without a separate
+//  harness. The case hands the body which receives a byte span and the corpus directory:
+//
+//     template<> void tested::Case<CASE_COUNTER>(tested::IRuntime* runtime)
+//     {
+//        runtime->StartCase("parse");
+//        tested::fuzz::Target("fuzz/parse", [](tested::data::Bytes input)
+//        {
+//           Document document;
+//           if (Parse(input, document))
+//              tested::Eq(Parse(Print(document)), document, "Printed document is parsed back");
+//        });
+//     }
+//
+//  In the regular runs the body is called for each input of the corpus and for each crash
+//  reproducer in "crashes" subdirectory, so the corpus works as the regression suite. Runner
+//  runs the same case as the fuzz target: one worker process per core mutates the inputs of the
+//  corpus and keeps the inputs which reach new edges, workers exchange them through the corpus
+//  directory. The input which fails the case or crashes the worker is minimized and saved as
+//  "crashes/crash-<hash>":
+//
+//     tested::fuzz::Runner runner;
+//     tested::Subset subset = tested::Storage::Instance().ByAddress("parser:parse");
+//     runner.Run(subset);
+//
+//  The edge coverage comes from the compiler instrumentation. Build the code under test with
+//  -fsanitize-coverage=trace-pc-guard (clang) or -fsanitize-coverage=trace-pc (gcc) and define
+//  TESTED_FUZZ_COVERAGE in one translation unit which includes this header, it defines the
+//  instrumentation callbacks. Without the instrumentation the mutations are blind. The callbacks
+//  themselves are excluded from the instrumentation by the attribute, gcc before 12 has none and
+//  needs them in the translation unit built without -fsanitize-coverage (see TESTED_NO_COVERAGE).
+//
+#pragma once
+
+#include "tested.h"
+#include "tested_check.h"
+#include "tested_data.h"
+
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define TESTED_FUZZ_SUPPORTED 1
+#endif
+
+// The callbacks must not be instrumented themselves. The compiler without the attribute (gcc 
+// before 12) leaves it to the build: the translation unit which defines TESTED_FUZZ_COVERAGE is
+// compiled without -fsanitize-coverage and defines TESTED_NO_COVERAGE empty to confirm it.
+#if !defined(TESTED_NO_COVERAGE) && defined(__has_attribute)
+#if __has_attribute(no_sanitize_coverage)
+#define TESTED_NO_COVERAGE __attribute__((no_sanitize_coverage))
+#elif defined(__clang__)
+#define TESTED_NO_COVERAGE __attribute__((no_sanitize("coverage")))
+#endif
+#endif
+#if !defined(TESTED_NO_COVERAGE) && defined(TESTED_FUZZ_COVERAGE)
+#error "The coverage callbacks would be instrumented, build them without -fsanitize-coverage and define TESTED_NO_COVERAGE empty"
+#endif
+#if !defined(TESTED_NO_COVERAGE)
+#define TESTED_NO_COVERAGE
+#endif
+
+namespace tested {
+namespace fuzz {
+
+enum
+{
+   kMaxEdges = 1 << 16,
+   kMaxWorkers = 64
+};
+
+// Hit counters of the edges by the last input, filled by the instrumentation callbacks
+struct Coverage
+{
+   static inline uint8_t  Hits[kMaxEdges];
+   static inline uint32_t Guards = 0;
+
+   // Buckets of hit counts (1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+) as bits, so the loop adds
+   // coverage only when its trip count changes noticeably
+   static uint8_t Bucket(uint8_t hits)
+   {
+      if (hits <= 3)
+         return static_cast<uint8_t>(1u << (hits - 1));
+      if (hits <= 7)
+         return 8;
+      if (hits <= 15)
+         return 16;
+      if (hits <= 31)
+         return 32;
+      return hits <= 127 ? 64 : 128;
+   }
+};
+
+} // namespace fuzz
+} // namespace tested
+
+#if defined(TESTED_FUZZ_COVERAGE)
+extern "C" {
+
+TESTED_NO_COVERAGE __attribute__((weak))
+void __sanitizer_cov_trace_pc_guard_init(uint32_t* start, uint32_t* stop)
+{
+   if (start == stop || *start != 0)
+      return;
+   for (uint32_t* guard = start; guard < stop; ++guard)
+      *guard = 1 + (tested::fuzz::Coverage::Guards++ % (tested::fuzz::kMaxEdges - 1));
+}
+
+TESTED_NO_COVERAGE __attribute__((weak))
+void __sanitizer_cov_trace_pc_guard(uint32_t* guard)
+{
+   uint8_t& hits = tested::fuzz::Coverage::Hits[*guard];
+   hits = static_cast<uint8_t>(hits + (hits != 255));
+}
+
+// gcc has no guards, the edge is the hashed address of the instrumented code
+TESTED_NO_COVERAGE __attribute__((weak))
+void __sanitizer_cov_trace_pc()
+{
+   const uintptr_t pc = reinterpret_cast<uintptr_t>(__builtin_return_address(0));
+   uint8_t& hits = tested::fuzz::Coverage::Hits[(pc ^ (pc >> 16)) % tested::fuzz::kMaxEdges];
+   hits = static_cast<uint8_t>(hits + (hits != 255));
+}
+
+} // extern "C"
+#endif
+
+namespace tested {
+namespace fuzz {
+
+typedef data::Bytes Bytes;
+typedef std::vector<uint8_t> Input;
+
+struct Options
+{
+   int      Workers;       // 0 is one worker for each cpu
+   uint64_t Runs;          // inputs per worker, 0 is no limit
+   int      Seconds;       // fuzzing time, 0 is no limit
+   size_t   MaxInputSize;
+   size_t   MinimizeRuns;  // executions of the crash minimization
+   uint64_t Seed;
+
+   Options()
+      : Workers(0), Runs(0), Seconds(60), MaxInputSize(4096), MinimizeRuns(2048),
+        Seed(check::DefaultSeed())
+   {}
+};
+
+enum Mode_t
+{
+   Mode_Replay,   // regular run, the corpus and the crashes are the regression inputs
+   Mode_Fuzz,     // the worker of Runner
+   Mode_Minimize  // Runner minimizes the crashes found by the workers
+};
+
+// Written by the workers into the memory shared with Runner
+struct WorkerStatus
+{
+   std::atomic<uint64_t> Runs;
+   std::atomic<uint32_t> CorpusSize;
+   std::atomic<uint32_t> Edges;
+   std::atomic<bool>     Crashed;
+};
+
+struct SharedState
+{
+   std::atomic<bool> Stop;
+   WorkerStatus      Workers[kMaxWorkers];
+};
+
+// How the fuzz targets run in this process
+struct Session
+{
+   Mode_t       Mode;
+   int          Worker;
+   Options      Settings;
+   SharedState* Shared;
+
+   static Session& Current()
+   {
+      static Session s_session = { Mode_Replay, 0, Options(), nullptr };
+      return s_session;
+   }
+};
+
+#if defined(TESTED_FUZZ_SUPPORTED)
+
+// Corpus directory: one file for each input named by the hash of the content
+struct CorpusFiles
+{
+   static void Path(char (&path)[data::kMaxPath], const char* directory, const char* name)
+   {
+      const int length = snprintf(path, sizeof(path), "%s/%s", directory, name);
+      if (length < 0 || length >= data::kMaxPath)
+         Fail("Corpus path is too long");
+   }
+
+   static void HashName(const uint8_t* data, size_t size, char (&name)[32], const char* prefix = "")
+   {
+      uint64_t hash = 0xcbf29ce484222325ull;
+      for (size_t i = 0; i < size; ++i)
+         hash = (hash ^ data[i]) * 0x100000001b3ull;
+      snprintf(name, sizeof(name), "%s%016llx", prefix, static_cast<unsigned long long>(hash));
+   }
+
+   // Names of the regular files in the order of names, hidden files are skipped
+   static void List(const char* directory, std::vector<std::string>& names)
+   {
+      names.clear();
+      dirent** entries = nullptr;
+      const int count = scandir(directory, &entries, nullptr, alphasort);
+      for (int i = 0; i < count; ++i)
+      {
+         char path[data::kMaxPath];
+         struct stat info;
+         if (entries[i]->d_name[0] != '.' &&
+            snprintf(path, sizeof(path), "%s/%s", directory, entries[i]->d_name) < data::kMaxPath &&
+            stat(path, &info) == 0 && S_ISREG(info.st_mode))
+            names.push_back(entries[i]->d_name);
+         free(entries[i]);
+      }
+      free(entries);
+   }
+
+   static bool Read(const char* path, Input& input)
+   {
+      input.clear();
+      FILE* file = fopen(path, "rb");
+      if (file == nullptr)
+         return false;
+
+      uint8_t buffer[4096];
+      size_t size;
+      while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+         input.insert(input.end(), buffer, buffer + size);
+      fclose(file);
+      return true;
+   }
+
+   // The file is written under the temporary name and renamed, so the other workers never read
+   // a partial input
+   static bool Write(const char* directory, const char* name, const uint8_t* data, size_t size)
+   {
+      char path[data::kMaxPath];
+      char tmpPath[data::kMaxPath];
+      Path(path, directory, name);
+      snprintf(tmpPath, sizeof(tmpPath), "%s/.tmp.%d", directory, static_cast<int>(getpid()));
+
+      FILE* file = fopen(tmpPath, "wb");
+      if (file == nullptr)
+         return false;
+      const bool written = (size == 0 || fwrite(data, 1, size, file) == size) && fclose(file) == 0;
+      if (!written || rename(tmpPath, path) != 0)
+      {
+         remove(tmpPath);
+         return false;
+      }
+      return true;
+   }
+
+   static void MakeDirectory(const char* path) { mkdir(path, 0755); }
+};
+
+// Saves the input which crashed the worker with a signal, only async-signal-safe calls here
+struct CrashHandler
+{
+   static inline char           CrashesPath[data::kMaxPath];
+   static inline char           PendingPath[data::kMaxPath];
+   static inline const uint8_t* Data = nullptr;
+   static inline size_t         Size = 0;
+   static inline WorkerStatus*  Status = nullptr;
+
+   static void Install(const char* crashesPath, const char* pendingPath, WorkerStatus* status)
+   {
+      snprintf(CrashesPath, sizeof(CrashesPath), "%s", crashesPath);
+      snprintf(PendingPath, sizeof(PendingPath), "%s", pendingPath);
+      Status = status;
+      const int signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+      for (int signalNumber : signals)
+         signal(signalNumber, OnSignal);
+   }
+
+   static void OnSignal(int signalNumber)
+   {
+      mkdir(CrashesPath, 0755);
+      const int fd = open(PendingPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd >= 0)
+      {
+         size_t written = 0;
+         while (written < Size)
+         {
+            const ssize_t result = write(fd, Data + written, Size - written);
+            if (result <= 0)
+               break;
+            written += static_cast<size_t>(result);
+         }
+         close(fd);
+      }
+      if (Status != nullptr)
+         Status->Crashed = true;
+
+      signal(signalNumber, SIG_DFL);
+      raise(signalNumber);
+   }
+};
+
+// Runs the body in the child process, true if the input fails the body or crashes the child
+template <typename BodyT>
+inline bool Crashes(BodyT& body, const Input& input)
+{
+   fflush(stdout);
+   const pid_t pid = fork();
+   if (pid < 0)
+      Fail("Cannot fork to minimize the crash");
+
+   if (pid == 0)
+   {
+      const int null = open("/dev/null", O_WRONLY);
+      dup2(null, STDOUT_FILENO);
+      dup2(null, STDERR_FILENO);
+      try
+      {
+         body(Bytes(input.data(), input.size()));
+      }
+      catch (...)
+      {
+         _exit(1);
+      }
+      _exit(0);
+   }
+
+   int status = 0;
+   waitpid(pid, &status, 0);
+   return WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0);
+}
+
+// The fuzzing loop of one worker
+template <typename BodyT>
+class Engine
+{
+public:
+   Engine(const char* corpus, BodyT& body, Session& session)
+      : m_corpus(corpus), m_body(body), m_session(session),
+        m_status(session.Shared->Workers[session.Worker]),
+        m_rng(session.Settings.Seed, static_cast<uint64_t>(session.Worker)), m_edges(0)
+   {
+      memset(m_seen, 0, sizeof(m_seen));
+      CorpusFiles::Path(m_crashes, corpus, "crashes");
+   }
+
+   void Run()
+   {
+      // The crashes directory is made only when there is the crash to save
+      CorpusFiles::MakeDirectory(m_corpus);
+      char pendingName[32];
+      snprintf(pendingName, sizeof(pendingName), ".pending.%d", m_session.Worker);
+      CorpusFiles::Path(m_pendingPath, m_crashes, pendingName);
+      CrashHandler::Install(m_crashes, m_pendingPath, &m_status);
+
+      Sync();
+      if (m_inputs.empty())
+         m_inputs.push_back(Input());
+
+      const Options& options = m_session.Settings;
+      const auto started = std::chrono::steady_clock::now();
+      const auto deadline = started + std::chrono::seconds(options.Seconds);
+      uint64_t runs = 0;
+      Input input;
+      while (true)
+      {
+         if ((runs & 1023) == 0)
+         {
+            m_status.Runs = runs;
+            m_status.CorpusSize = static_cast<uint32_t>(m_inputs.size());
+            m_status.Edges = m_edges;
+            if (m_session.Shared->Stop || (options.Runs != 0 && runs >= options.Runs) ||
+               (options.Seconds != 0 && std::chrono::steady_clock::now() >= deadline))
+               break;
+            if ((runs & 8191) == 0)
+               Sync();
+         }
+
+         input = m_inputs[m_rng.Below(m_inputs.size())];
+         Mutate(input);
+         ++runs;
+
+         Text failure;
+         if (!Execute(input, failure))
+            ReportCrash(input, failure);
+         if (Merge())
+            Add(input, true);
+      }
+      m_status.Runs = runs;
+   }
+
+private:
+   typedef check::Text<512> Text;
+
+   // Runs the body on the input, the hits are collected by the coverage callbacks
+   bool Execute(const Input& input, Text& failure)
+   {
+      memset(Coverage::Hits, 0, sizeof(Coverage::Hits));
+      CrashHandler::Data = input.data();
+      CrashHandler::Size = input.size();
+      try
+      {
+         m_body(Bytes(input.data(), input.size()));
+         return true;
+      }
+      catch (...)
+      {
+         check::PrintCurrentException(failure.Out);
+         return false;
+      }
+   }
+
+   // True if the last input reached the new edges or the new hit count buckets of the edges
+   bool Merge()
+   {
+      bool found = false;
+      for (size_t word = 0; word < kMaxEdges; word += sizeof(uint64_t))
+      {
+         uint64_t hits;
+         memcpy(&hits, Coverage::Hits + word, sizeof(hits));
+         if (hits == 0)
+            continue;
+
+         for (size_t edge = word; edge < word + sizeof(uint64_t); ++edge)
+         {
+            if (Coverage::Hits[edge] == 0)
+               continue;
+            const uint8_t bucket = Coverage::Bucket(Coverage::Hits[edge]);
+            if ((m_seen[edge] & bucket) != 0)
+               continue;
+            m_edges += m_seen[edge] == 0;
+            m_seen[edge] |= bucket;
+            found = true;
+         }
+      }
+      return found;
+   }
+
+   void Add(const Input& input, bool save)
+   {
+      m_inputs.push_back(input);
+      char name[32];
+      CorpusFiles::HashName(input.data(), input.size(), name);
+      if (m_known.insert(name).second && save)
+         CorpusFiles::Write(m_corpus, name, input.data(), input.size());
+   }
+
+   // Picks up the inputs added by the other workers, the input is kept if it has new coverage
+   // for this worker
+   void Sync()
+   {
+      std::vector<std::string> names;
+      CorpusFiles::List(m_corpus, names);
+      Input input;
+      for (const std::string& name : names)
+      {
+         if (!m_known.insert(name).second)
+            continue;
+
+         char path[data::kMaxPath];
+         CorpusFiles::Path(path, m_corpus, name.c_str());
+         if (!CorpusFiles::Read(path, input))
+            continue;
+         if (input.size() > m_session.Settings.MaxInputSize)
+            input.resize(m_session.Settings.MaxInputSize);
+
+         Text failure;
+         if (!Execute(input, failure))
+            ReportCrash(input, failure);
+         if (Merge() || m_inputs.empty())
+            m_inputs.push_back(input);
+      }
+   }
+
+   // Stacked random mutations of the input
+   void Mutate(Input& input)
+   {
+      static const uint8_t interesting[] = { 0, 1, 0x7f, 0x80, 0xff, '0', ' ', '\n' };
+      const size_t maxSize = m_session.Settings.MaxInputSize;
+      const uint64_t count = 1 + m_rng.Below(4);
+      for (uint64_t i = 0; i < count; ++i)
+      {
+         const size_t size = input.size();
+         const size_t position = static_cast<size_t>(m_rng.Below(size));
+         switch (size == 0 ? 2 : m_rng.Below(8))
+         {
+         case 0:
+            input[position] ^= static_cast<uint8_t>(1u << m_rng.Below(8));
+            break;
+         case 1:
+            input[position] = static_cast<uint8_t>(m_rng.Next());
+            break;
+         case 2:
+         {
+            const size_t inserted = static_cast<size_t>(1 + m_rng.Below(4));
+            for (size_t k = 0; k < inserted && input.size() < maxSize; ++k)
+               input.insert(input.begin() + position, static_cast<uint8_t>(m_rng.Next()));
+            break;
+         }
+         case 3:
+         {
+            const size_t erased = static_cast<size_t>(1 + m_rng.Below((std::min)(size, size_t(8))));
+            input.erase(input.begin() + position,
+               input.begin() + (std::min)(size, position + erased));
+            break;
+         }
+         case 4:
+            input[position] = interesting[m_rng.Below(sizeof(interesting))];
+            break;
+         case 5:
+            input[position] = static_cast<uint8_t>(input[position] + m_rng.Range(-16, 16));
+            break;
+         case 6:
+         {
+            const size_t from = static_cast<size_t>(m_rng.Below(size));
+            const size_t length = static_cast<size_t>(
+               1 + m_rng.Below((std::min)(size - (std::max)(from, position), size_t(32))));
+            memmove(&input[position], &input[from], length);
+            break;
+         }
+         default:
+         {
+            // Splice with the other input of the corpus
+            const Input& other = m_inputs[m_rng.Below(m_inputs.size())];
+            const size_t from = static_cast<size_t>(m_rng.Below(other.size() + 1));
+            input.resize(position);
+            input.insert(input.end(), other.begin() + from, other.end());
+            if (input.size() > maxSize)
+               input.resize(maxSize);
+            break;
+         }
+         }
+      }
+   }
+
+   // The crash is saved for the minimization by Runner and all workers stop
+   void ReportCrash(const Input& input, const Text& failure)
+   {
+      char pendingName[32];
+      snprintf(pendingName, sizeof(pendingName), ".pending.%d", m_session.Worker);
+      CorpusFiles::MakeDirectory(m_crashes);
+      CorpusFiles::Write(m_crashes, pendingName, input.data(), input.size());
+      m_status.Crashed = true;
+      m_session.Shared->Stop = true;
+
+      check::Text<1024> message;
+      message.Out.Printf("Worker %d found the crash on %zu bytes input: %s", m_session.Worker,
+         input.size(), failure.CData());
+      Fail(message.CData());
+   }
+
+   const char*      m_corpus;
+   char             m_crashes[data::kMaxPath];
+   char             m_pendingPath[data::kMaxPath];
+   BodyT&           m_body;
+   Session&         m_session;
+   WorkerStatus&    m_status;
+   check::Rng       m_rng;
+   std::vector<Input>    m_inputs;
+   std::set<std::string> m_known;
+   uint8_t          m_seen[kMaxEdges];
+   uint32_t         m_edges;
+};
+
+// Shrinks the pending crashes of the workers and saves them as the regression inputs
+template <typename BodyT>
+inline void MinimizeCrashes(const char* corpus, BodyT& body, const Options& options)
+{
+   char crashes[data::kMaxPath];
+   CorpusFiles::Path(crashes, corpus, "crashes");
+
+   check::Text<1024> report;
+   dirent** entries = nullptr;
+   const int count = scandir(crashes, &entries, nullptr, alphasort);
+   for (int i = 0; i < count; ++i)
+   {
+      char path[data::kMaxPath];
+      Input input;
+      const bool pending = strncmp(entries[i]->d_name, ".pending.", 9) == 0;
+      if (pending)
+         CorpusFiles::Path(path, crashes, entries[i]->d_name);
+      free(entries[i]);
+      if (!pending || !CorpusFiles::Read(path, input))
+         continue;
+
+      if (!Crashes(body, input))
+      {
+         report.Out.Printf("\n   %s does not reproduce", path);
+         continue;
+      }
+
+      // Chunks from the halves down to single bytes are removed, then bytes are zeroed
+      const size_t originalSize = input.size();
+      size_t runs = 0;
+      for (size_t chunk = input.size() / 2; chunk > 0 && runs < options.MinimizeRuns; chunk /= 2)
+      {
+         for (size_t start = 0; start + chunk <= input.size() && runs < options.MinimizeRuns;)
+         {
+            Input candidate(input.begin(), input.begin() + start);
+            candidate.insert(candidate.end(), input.begin() + start + chunk, input.end());
+            ++runs;
+            if (Crashes(body, candidate))
+               input.swap(candidate);
+            else
+               start += chunk;
+         }
+      }
+      for (size_t k = 0; k < input.size() && runs < options.MinimizeRuns; ++k)
+      {
+         if (input[k] == 0)
+            continue;
+         Input candidate(input);
+         candidate[k] = 0;
+         ++runs;
+         if (Crashes(body, candidate))
+            input.swap(candidate);
+      }
+
+      char name[32];
+      CorpusFiles::HashName(input.data(), input.size(), name, "crash-");
+      if (CorpusFiles::Write(crashes, name, input.data(), input.size()))
+         remove(path);
+      report.Out.Printf("\n   %s/%s (%zu bytes, minimized from %zu)", crashes, name, input.size(),
+         originalSize);
+   }
+   free(entries);
+
+   if (report.Out.Length != 0)
+   {
+      check::Text<1024> message;
+      message.Out.Printf("Crashes saved as regression inputs:%s", report.CData());
+      Fail(message.CData());
+   }
+}
+
+#endif // TESTED_FUZZ_SUPPORTED
+
+// Regular run: the body is called for each input of the corpus and of the crashes
+template <typename BodyT>
+inline void Replay(const char* corpus, BodyT& body)
+{
+#if defined(TESTED_FUZZ_SUPPORTED)
+   char crashes[data::kMaxPath];
+   CorpusFiles::Path(crashes, corpus, "crashes");
+   const char* directories[] = { corpus, crashes };
+
+   std::vector<std::string> names;
+   Input input;
+   for (const char* directory : directories)
+   {
+      CorpusFiles::List(directory, names);
+      for (const std::string& name : names)
+      {
+         char path[data::kMaxPath];
+         CorpusFiles::Path(path, directory, name.c_str());
+         if (!CorpusFiles::Read(path, input))
+            continue;
+
+         try
+         {
+            body(Bytes(input.data(), input.size()));
+         }
+         catch (...)
+         {
+            check::Text<1024> message;
+            message.Out.Printf("Input %s ", path);
+            check::PrintCurrentException(message.Out);
+            Fail(message.CData());
+         }
+      }
+   }
+#else
+   (void)corpus;
+   (void)body;
+#endif
+}
+
+// The fuzz target: the body receives Bytes of the input, the corpus is the directory of inputs
+// (relative path is resolved against TESTED_DATA_DIR)
+template <typename BodyT>
+inline void Target(const char* corpusDirectory, BodyT body)
+{
+   char corpus[data::kMaxPath];
+   data::FileMapping::ResolvePath(corpusDirectory, corpus);
+
+   Session& session = Session::Current();
+#if defined(TESTED_FUZZ_SUPPORTED)
+   if (session.Mode == Mode_Fuzz)
+   {
+      Engine<BodyT> engine(corpus, body, session);
+      engine.Run();
+      return;
+   }
+   if (session.Mode == Mode_Minimize)
+   {
+      MinimizeCrashes(corpus, body, session.Settings);
+      return;
+   }
+#endif
+   Replay(corpus, body);
+}
+
+// Runs the fuzz targets of the subset in the worker processes until the time or runs limit or
+// the first crash, then minimizes the crashes. Returns the summary of the workers.
+class Runner
+{
+public:
+   explicit Runner(Options options = Options()) : m_options(options)
+   {
+      if (m_options.Workers <= 0)
+         m_options.Workers = static_cast<int>((std::max)(1u, std::thread::hardware_concurrency()));
+      if (m_options.Workers > kMaxWorkers)
+         m_options.Workers = kMaxWorkers;
+   }
+
+   Subset::Stats Run(Subset& subset, Subset::IRunObserver* observer = nullptr)
+   {
+      Subset::StdoutReporter consoleReporter;
+      if (observer == nullptr)
+         observer = &consoleReporter;
+
+      Subset::Stats total;
+#if defined(TESTED_FUZZ_SUPPORTED)
+      void* shared = mmap(nullptr, sizeof(SharedState), PROT_READ | PROT_WRITE,
+         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+      if (shared == MAP_FAILED)
+      {
+         printf("Failed to map the fuzzing state\n");
+         total.Failed = 1;
+         return total;
+      }
+      SharedState* state = new (shared) SharedState();
+
+      Session& session = Session::Current();
+      session.Settings = m_options;
+      session.Shared = state;
+
+      printf("Fuzzing in %d workers, seed 0x%llx\n", m_options.Workers,
+         static_cast<unsigned long long>(m_options.Seed));
+      fflush(stdout);
+
+      int started = 0;
+      for (; started < m_options.Workers; ++started)
+      {
+         const pid_t pid = fork();
+         if (pid < 0)
+            break;
+         if (pid == 0)
+         {
+            session.Mode = Mode_Fuzz;
+            session.Worker = started;
+            const Subset::Stats stats = subset.Run(observer);
+            fflush(stdout);
+            _exit(stats.Failed != 0 ? 1 : 0);
+         }
+      }
+
+      // The workers which have started go on, the run fails only if none has
+      if (started < m_options.Workers)
+         printf("Failed to start all fuzzing workers, fuzzing in %d\n", started);
+      if (started == 0)
+         total.Failed = 1;
+
+      int running = started;
+      auto lastStatus = std::chrono::steady_clock::now();
+      while (running > 0)
+      {
+         int status = 0;
+         const pid_t pid = waitpid(-1, &status, WNOHANG);
+         if (pid > 0)
+         {
+            --running;
+            if (WIFSIGNALED(status))
+            {
+               printf("Fuzzing worker (pid %d) crashed with signal %d\n", static_cast<int>(pid),
+                  WTERMSIG(status));
+               state->Stop = true;
+            }
+            if (WIFSIGNALED(status) || WEXITSTATUS(status) != 0)
+               total.Failed += 1;
+            else
+               total.Passed += 1;
+            continue;
+         }
+
+         std::this_thread::sleep_for(std::chrono::milliseconds(100));
+         if (std::chrono::steady_clock::now() - lastStatus >= std::chrono::seconds(5))
+         {
+            lastStatus = std::chrono::steady_clock::now();
+            PrintStatus(*state, started);
+         }
+      }
+      PrintStatus(*state, started);
+
+      bool crashed = false;
+      for (int i = 0; i < started; ++i)
+         crashed = crashed || state->Workers[i].Crashed;
+      if (crashed)
+      {
+         printf("\nMinimizing the crashes\n");
+         session.Mode = Mode_Minimize;
+         subset.Run(observer);
+      }
+
+      session.Mode = Mode_Replay;
+      session.Shared = nullptr;
+      state->~SharedState();
+      munmap(shared, sizeof(SharedState));
+#else
+      printf("Fuzzing is not supported on this platform\n");
+      total = subset.Run(observer);
+#endif
+      return total;
+   }
+
+private:
+#if defined(TESTED_FUZZ_SUPPORTED)
+   static void PrintStatus(const SharedState& state, int workers)
+   {
+      uint64_t runs = 0;
+      uint32_t corpus = 0;
+      uint32_t edges = 0;
+      for (int i = 0; i < workers; ++i)
+      {
+         runs += state.Workers[i].Runs;
+         corpus = (std::max)(corpus, state.Workers[i].CorpusSize.load());
+         edges = (std::max)(edges, state.Workers[i].Edges.load());
+      }
+      printf("fuzz: %llu runs, corpus %u inputs, %u edges\n",
+         static_cast<unsigned long long>(runs), corpus, edges);
+      fflush(stdout);
+   }
+#endif
+
+   Options m_options;
+};
+
+} // namespace fuzz
+} // namespace tested
@@ -0,0 +1,43 @@
+//
+//   \|/ Tested
+//   /|\ Sleep meter
+//
+//  The sleep functions which tested::SleepMeter counts, so the runner reports the real sleeps 
+//  of each case. Exactly one translation unit of the test executable includes this header, e.g.
+//  the one with main(): nanosleep(), clock_nanosleep(), usleep() and sleep() defined here take 
+//  the place of the libc ones (Linux only, elsewhere the header defines nothing).
+//
+#pragma once
+
+#include "tested_async.h"
+
+#if defined(TESTED_SLEEP_METER_SUPPORTED)
+
+extern "C" int clock_nanosleep(clockid_t clock, int flags, const timespec* request, 
+   timespec* remain)
+{
+   return tested::SleepMeter::Sleep(clock, flags, request, remain) == 0 ? 0 : errno;
+}
+
+extern "C" int nanosleep(const timespec* request, timespec* remain)
+{
+   return tested::SleepMeter::Sleep(CLOCK_MONOTONIC, 0, request, remain);
+}
+
+extern "C" int usleep(useconds_t microseconds)
+{
+   const timespec request = { static_cast<time_t>(microseconds / 1000000), 
+      static_cast<long>(microseconds % 1000000) * 1000 };
+   return nanosleep(&request, nullptr);
+}
+
+extern "C" unsigned int sleep(unsigned int seconds)
+{
+   const timespec request = { static_cast<time_t>(seconds), 0 };
+   timespec remain = { 0, 0 };
+   if (nanosleep(&request, &remain) == 0)
+      return 0;
+   return static_cast<unsigned int>(remain.tv_sec) + (remain.tv_nsec > 0 ? 1 : 0);
+}
+
+#endif